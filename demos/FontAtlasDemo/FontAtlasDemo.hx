@@ -0,0 +1,46 @@
+class FontAtlasDemo {
+   public function new() {
+      var atlas: flash.display.Bitmap = Type.createInstance(Type.resolveClass("resources.classes.CourierAtlas"), []);
+      var metrics = new FontAtlasMetrics(Type.createInstance(Type.resolveClass("resources.classes.CourierAtlasMetrics"), []));
+
+      draw(atlas.bitmapData, metrics.getSize(18), "This text is drawn from the glyph atlas!", 10, 10);
+      draw(atlas.bitmapData, metrics.getSize(32), "Hello Atlas!", 10, 50);
+   }
+
+   function draw(atlas: flash.display.BitmapData, size: FontAtlasSize, text: String, x: Int, y: Int) {
+      var canvas = new flash.display.BitmapData(380, size.height, true, 0);
+      var pen_x = 0;
+      var prev = -1;
+
+      for(i in 0...text.length) {
+         var code = text.charCodeAt(i);
+         var glyph = size.getGlyph(code);
+         if(glyph == null)
+            continue;
+
+         if(prev >= 0)
+            pen_x += size.getKerning(prev, code);
+
+         canvas.copyPixels(
+            atlas,
+            new flash.geom.Rectangle(glyph.x, glyph.y, glyph.width, glyph.height),
+            new flash.geom.Point(pen_x + glyph.left, size.ascent - glyph.top)
+         );
+
+         pen_x += glyph.advance;
+         prev = code;
+      }
+
+      // The atlas is white, tint it to black
+      canvas.colorTransform(canvas.rect, new flash.geom.ColorTransform(0, 0, 0));
+
+      var bitmap = new flash.display.Bitmap(canvas);
+      bitmap.x = x;
+      bitmap.y = y;
+      flash.Lib.current.addChild(bitmap);
+   }
+   
+   public static function main() {
+      new FontAtlasDemo();
+   }
+}
@@ -0,0 +1,153 @@
+/*
+   Class: FontAtlasMetrics
+      Reader of the metrics table exported by the <font:atlas> element of the Font module.
+      It is not specific to this demo, copy it to your project to use glyph atlases.
+
+      (code)
+      var metrics = new FontAtlasMetrics(Type.createInstance(Type.resolveClass("resources.DigitsMetrics"), []));
+      var size = metrics.getSize(32);
+      var glyph = size.getGlyph("7".charCodeAt(0));
+      (end)
+*/
+
+typedef FontAtlasGlyph = {
+   var charCode: Int;
+
+   // Position and size in the glyph bitmap
+   var x: Int;
+   var y: Int;
+   var width: Int;
+   var height: Int;
+
+   // Offset of the glyph bitmap from the pen position, y grows upwards
+   var left: Int;
+   var top: Int;
+
+   var advance: Int;
+}
+
+class FontAtlasSize {
+   public var size(default, null): Int;
+   public var ascent(default, null): Int;
+   public var descent(default, null): Int;
+   public var height(default, null): Int;
+
+   var glyphs: IntHash<FontAtlasGlyph>;
+   var kerning: IntHash<IntHash<Int>>;
+
+   public function new(size: Int, ascent: Int, descent: Int, height: Int) {
+      this.size = size;
+      this.ascent = ascent;
+      this.descent = descent;
+      this.height = height;
+
+      glyphs = new IntHash();
+      kerning = new IntHash();
+   }
+
+   public function addGlyph(glyph: FontAtlasGlyph) {
+      glyphs.set(glyph.charCode, glyph);
+   }
+
+   public function addKerning(leftChar: Int, rightChar: Int, x: Int) {
+      var pairs = kerning.get(leftChar);
+      if(pairs == null) {
+         pairs = new IntHash();
+         kerning.set(leftChar, pairs);
+      }
+
+      pairs.set(rightChar, x);
+   }
+
+   /*
+      Function: getGlyph
+         Returns the glyph of the given character or null if the atlas doesn't contain it.
+   */
+   public function getGlyph(charCode: Int): FontAtlasGlyph {
+      return glyphs.get(charCode);
+   }
+
+   /*
+      Function: getKerning
+         Returns the horizontal adjustment of the pen position between two characters.
+   */
+   public function getKerning(leftChar: Int, rightChar: Int): Int {
+      var pairs = kerning.get(leftChar);
+      if(pairs == null || !pairs.exists(rightChar))
+         return 0;
+
+      return pairs.get(rightChar);
+   }
+}
+
+class FontAtlasMetrics {
+   public static inline var VERSION = 1;
+
+   public var sdf(default, null): Bool;
+   public var spread(default, null): Int;
+   public var width(default, null): Int;
+   public var height(default, null): Int;
+   public var sizes(default, null): Array<FontAtlasSize>;
+
+   public function new(data: flash.utils.ByteArray) {
+      data.endian = flash.utils.Endian.LITTLE_ENDIAN;
+      data.position = 0;
+
+      var version = data.readUnsignedShort();
+      if(version != VERSION)
+         throw "Unsupported glyph atlas metrics version: " + version + "!";
+
+      sdf = data.readUnsignedByte() == 1;
+      spread = data.readUnsignedByte();
+      width = data.readUnsignedShort();
+      height = data.readUnsignedShort();
+
+      sizes = new Array();
+      var num_sizes = data.readUnsignedShort();
+      for(i in 0...num_sizes) {
+         var pixel_size = data.readUnsignedShort();
+         var ascent = data.readShort();
+         var descent = data.readShort();
+         var line_height = data.readShort();
+         var size = new FontAtlasSize(pixel_size, ascent, descent, line_height);
+
+         // Counts and character codes are below 2^30, so they can be read as signed values
+         var num_glyphs = data.readInt();
+         for(j in 0...num_glyphs) {
+            // Read in order, the evaluation order of object fields is not specified
+            var char_code = data.readInt();
+            var x = data.readUnsignedShort();
+            var y = data.readUnsignedShort();
+            var w = data.readUnsignedShort();
+            var h = data.readUnsignedShort();
+            var left = data.readShort();
+            var top = data.readShort();
+            var advance = data.readShort();
+
+            size.addGlyph({ charCode: char_code, x: x, y: y, width: w, height: h, left: left, top: top, advance: advance });
+         }
+
+         var num_kerning = data.readInt();
+         for(j in 0...num_kerning) {
+            var left_char = data.readInt();
+            var right_char = data.readInt();
+
+            size.addKerning(left_char, right_char, data.readShort());
+         }
+
+         sizes.push(size);
+      }
+   }
+
+   /*
+      Function: getSize
+         Returns the metrics of the given pixel size or null if the atlas doesn't contain it.
+   */
+   public function getSize(pixelSize: Int): FontAtlasSize {
+      for(size in sizes)
+         if(size.size == pixelSize)
+            return size;
+
+      return null;
+   }
+}
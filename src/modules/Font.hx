@@ -1,6 +1,6 @@
 /*
    Title: Font.hx
-      Font import module for importing TrueType fonts.
+      Font import module for importing TrueType fonts as vector glyphs or pre-rendered glyph atlases.
 
    Section: ttf
       Imports specified glyphs (character drawings) from a TrueType font file as DefineFont2 swf tag.
@@ -18,11 +18,19 @@
             *false* (don't generate neither symbol nor AS3 class stub),
             *symbolOnly* (generate only symbol),
             *symbolAndClass* (generate symbol and AS3 class stub)
+      tolerance - Turns on glyph outline optimization: degenerate edges are dropped, curves deviating less
+         than tolerance from a straight line become lines and (nearly) collinear lines are merged. Measured
+         in 1/1024 em units, 0 keeps the outlines intact. A curve turned into a line may be merged with
+         collinear lines afterwards, so the outline can move by up to 2 times the tolerance. The glyph
+         shape sizes before and after the optimization are reported.
+      grid - Relevant only if tolerance is set. Snaps every outline point to a grid of the given size
+         (in 1/1024 em units) which turns small deviations into horizontal / vertical edges.
+         Default is 0 (no snapping).
 
    Child nodes:
-      <ttf> has only one child node so far: *<characters>* which has two other optional child nodes
+      <ttf> has only one child node so far: *<characters>* which has three other optional child nodes
       *<include>* and *<exclude>* for specifying indivudal characters or character ranges to import / omit
-      respectively.
+      respectively and *<corpus>* for including every character used in a set of text files.
       
       If <ttf> doesn't have
       any child nodes then every character which appear in the file are imported.
@@ -40,6 +48,18 @@
    Optional attributes:
       range - Range of characters in the form: *firstCharacter..lastCharacter*
       characters - Individual characters in arbitrary order
+
+   Group: corpus (child of <characters>)
+      Includes every character which appears in the given UTF-8 encoded text files (e.g. localization files).
+      Control characters and byte order marks are ignored. Like <include> and <exclude> it is applied in
+      document order so a later <exclude> can still remove characters from the set.
+
+   Mandatory attributes:
+      path - Path to a text file or to a directory which is scanned recursively. Files and directories
+         whose name starts with a dot (e.g. _.svn_) are skipped.
+
+   Optional attributes:
+      glob - Comma separated list of file name patterns (*, ? wildcards). Mandatory if path is a directory.
      
    Example 1:
       Assuming that Font import module is assigned to namespace _font_ the following snippet imports
@@ -56,6 +76,18 @@
       (end) 
       
    Example 2:
+      Import only the characters used by the localization files of the game plus the digits:
+
+      (code)
+      <font:ttf import="mplus.ttf" name="MPlus">
+         <font:characters>
+            <font:corpus path="locale" glob="*.xml,*.json,*.po"/>
+            <font:include range="0..9"/>
+         </font:characters>
+      </font:ttf>
+      (end)
+
+   Example 3:
       For runtime font loading support, class stub can be generated for the font by
       specifying a class name.
      
@@ -81,10 +113,89 @@
       tf.embedFonts = true;
       tf.defaultTextFormat = new flash.text.TextFormat("Arial", 14);
       (end)
+
+   Section: atlas
+      Renders the specified glyphs of a TrueType font file to a single DefineBitsLossless2 swf tag
+      (either as anti-aliased bitmaps or as signed distance fields) and stores the glyph positions,
+      metrics and kerning in a DefineBinaryData swf tag. Requires flash version 9 or higher.
+
+   Mandatory attributes:
+      import - Path to the file to be imported.
+      class - Class name assigned to the glyph bitmap. The metrics table gets the same class name
+         with a _Metrics_ suffix.
+      sizes - Comma separated list of pixel sizes to render the glyphs at.
+
+   Optional attributes:
+      mode - (_bitmap_, sdf) Renders anti-aliased glyph bitmaps or signed distance fields.
+      spread - Relevant only for signed distance fields. The distance in pixels mapped to the
+         full 0..255 range (1..255, default: 4). The edge of the glyphs is at value 128.
+         The distances are computed from the glyphs rendered at 4 times the requested size
+         and averaged down, so the edge is placed with sub-pixel accuracy.
+      padding - Empty pixels between the glyphs in the bitmap (default: 1).
+      genclass - (false, symbolOnly, _symbolAndClass_) Controls the generation of symbols and AS3 class stubs.
+         Available values are:
+            *false* (don't generate neither symbol nor AS3 class stub),
+            *symbolOnly* (generate only symbol),
+            *symbolAndClass* (generate symbol and AS3 class stub)
+
+   Child nodes:
+      The same *<characters>* node as in case of <ttf>.
+
+   Superclass:
+      flash.display.Bitmap - The superclass of the glyph bitmap class stub.
+      flash.utils.ByteArray - The superclass of the metrics table class stub.
+
+   Bitmap limits:
+      The glyph bitmap has to fit the BitmapData limits of the target flash version (2880 pixels
+      per side for flash 9, 8191 pixels per side and 16777215 pixels in total for flash 10 and
+      above). Embedded bitmaps of the font are ignored, glyphs are always rendered from outlines.
+
+   Metrics table format:
+      Every value is little endian (set _endian_ of the ByteArray to _flash.utils.Endian.LITTLE_ENDIAN_).
+      (code)
+      u16 version (1)
+      u8  mode (0 - bitmap, 1 - signed distance field)
+      u8  spread
+      u16 bitmap width
+      u16 bitmap height
+      u16 number of sizes
+      for every size:
+         u16 pixel size
+         s16 ascent
+         s16 descent
+         s16 line height
+         u32 number of glyphs
+         for every glyph:
+            u32 character code
+            u16 x, y, width, height (position in the bitmap)
+            s16 left, top (offset of the bitmap from the pen position, y grows upwards)
+            s16 advance
+         u32 number of kerning pairs
+         for every kerning pair:
+            u32 left character code
+            u32 right character code
+            s16 adjustment
+      (end)
+
+      A ready-made reader of the table (in Haxe) is shipped as
+      _demos/FontAtlasDemo/FontAtlasMetrics.hx_, the FontAtlasDemo shows how to draw text with it.
+
+   Example:
+      Renders the digits as 32 pixel signed distance fields and exports them as _resources.Digits_
+      and _resources.DigitsMetrics_:
+
+      (code)
+      <font:atlas import="arial.ttf" class="resources.Digits" sizes="32" mode="sdf" spread="6">
+         <font:characters>
+            <font:include range="0..9"/>
+         </font:characters>
+      </font:atlas>
+      (end)
 */
 
 import haxe.xml.Check;
 import neko.io.File;
+import format.swf.Constants;
 import format.swf.Data;
 import SamHaXeModule;
 import Helpers;
@@ -120,10 +231,45 @@ typedef NativeFontData = {
    var ascend: Int;
    var descend: Int;
    var height: Int;
+   var original_shape_bytes: Int;
+   var shape_bytes: Int;
    var glyphs: Array<NativeGlyphData>;
    var kerning: Array<NativeKerningData>;
 }
 
+typedef NativeAtlasGlyphData = {
+   var char_code: Int;
+   var x: Int;
+   var y: Int;
+   var width: Int;
+   var height: Int;
+   var left: Int;
+   var top: Int;
+   var advance: Int;
+}
+
+typedef NativeAtlasKerningData = {
+   var left_char: Int;
+   var right_char: Int;
+   var x: Int;
+}
+
+typedef NativeAtlasSizeData = {
+   var size: Int;
+   var ascent: Int;
+   var descent: Int;
+   var height: Int;
+   var glyphs: Array<NativeAtlasGlyphData>;
+   var kerning: Array<NativeAtlasKerningData>;
+}
+
+typedef NativeAtlasData = {
+   var width: Int;
+   var height: Int;
+   var data: String;
+   var sizes: Array<NativeAtlasSizeData>;
+}
+
 class Font {
    static var interface_versions = ["1.0.0"];
    
@@ -133,6 +279,18 @@ class Font {
 
    static var superclass: String = "flash.text.Font";
 
+   static var atlas_superclass: String = "flash.display.Bitmap";
+
+   static var atlas_metrics_superclass: String = "flash.utils.ByteArray";
+
+   static inline var ATLAS_METRICS_VERSION = 1;
+
+   // BitmapData limits: flash 9 allows 2880 pixels per side, flash 10 allows 8191 pixels
+   // per side and 16777215 pixels in total
+   static inline var ATLAS_MAX_SIZE_9 = 2880;
+   static inline var ATLAS_MAX_SIZE_10 = 8191;
+   static inline var ATLAS_MAX_PIXELS_10 = 16777215;
+
    public function new() {
    }
 
@@ -145,7 +303,61 @@ class Font {
          throw "Invalid range attribute: '" + attr + "'. First character code should be less or equal than second!";
    }
 
+   function characters_rule(ns: String): Rule {
+      return ROptional(RNode(ns + "characters", null,
+         RMulti(RChoice([
+            RNode(ns + "include", [
+               //Att("range", FReg(~/^.\.\..$/), ""),
+               Att("range", null, ""),
+               Att("characters", null, "")
+            ]),
+            RNode(ns + "exclude", [
+               //Att("range", FReg(~/^.\.\..$/), ""),
+               Att("range", null, ""),
+               Att("characters", null, "")
+            ]),
+            RNode(ns + "corpus", [
+               Att("path"),
+               Att("glob", null, "")
+            ])
+         ]))
+      ));
+   }
+
+   function check_characters(font: NsFastXml): Void {
+      if(font.hasLNode.characters) {
+         for(n in font.lnode.characters.lnodes.include)
+            if(n.has.range && n.att.range.length > 0)
+               validateRangeAttrib(n.att.range);
+         
+         for(n in font.lnode.characters.lnodes.exclude)
+            if(n.has.range && n.att.range.length > 0)
+               validateRangeAttrib(n.att.range);
+
+         for(n in font.lnode.characters.lnodes.corpus) {
+            if(!neko.FileSystem.exists(n.att.path))
+               throw "Corpus path '" + n.att.path + "' not found!";
+
+            if(neko.FileSystem.isDirectory(n.att.path) && StringTools.trim(n.att.glob).length == 0)
+               throw "Corpus path '" + n.att.path + "' is a directory, glob attribute is required!";
+         }
+      }
+   }
+
    public function check_font_1_0(font: NsFastXml): Void {
+      switch(font.lname) {
+         case "ttf":
+            check_ttf(font);
+
+         case "atlas":
+            check_atlas(font);
+
+         default:
+            throw "Only the 'ttf' and 'atlas' tags are supported!";
+      }
+   }
+
+   function check_ttf(font: NsFastXml): Void {
       var ns = font.ns + ":";
      
       var font_rule = RNode(ns + "ttf", [
@@ -163,44 +375,77 @@ class Font {
             ),
 
             Att("language", FEnum(["none", "latin", "japanese", "korean", "simpleChinese", "traditionalChinese"]), "none"),
+            Att("tolerance", null, ""),
+            Att("grid", null, "0"),
          ],
 
          // Child nodes
-         ROptional(RNode(ns + "characters", null,
-            RMulti(RChoice([
-               RNode(ns + "include", [
-                  //Att("range", FReg(~/^.\.\..$/), ""),
-                  Att("range", null, ""),
-                  Att("characters", null, "")
-               ]),
-               RNode(ns + "exclude", [
-                  //Att("range", FReg(~/^.\.\..$/), ""),
-                  Att("range", null, ""),
-                  Att("characters", null, "")
-               ])
-            ]))
-         ))
+         characters_rule(ns)
       );
 
       haxe.xml.Check.checkNode(font.x, font_rule);
 
-      if(font.hasLNode.characters) {
-         for(n in font.lnode.characters.lnodes.include)
-            if(n.has.range && n.att.range.length > 0)
-               validateRangeAttrib(n.att.range);
-         
-         for(n in font.lnode.characters.lnodes.exclude)
-            if(n.has.range && n.att.range.length > 0)
-               validateRangeAttrib(n.att.range);
+      if(font.att.tolerance.length > 0) {
+         var tolerance = Std.parseFloat(font.att.tolerance);
+         if(Math.isNaN(tolerance) || tolerance < 0)
+            throw "Invalid tolerance attribute: '" + font.att.tolerance + "'. Tolerance should be a non-negative number!";
       }
+
+      var grid = Std.parseFloat(font.att.grid);
+      if(Math.isNaN(grid) || grid < 0)
+         throw "Invalid grid attribute: '" + font.att.grid + "'. Grid should be a non-negative number!";
+
+      check_characters(font);
+   }
+
+   function check_atlas(atlas: NsFastXml): Void {
+      var ns = atlas.ns + ":";
+     
+      var atlas_rule = RNode(ns + "atlas", [
+            // Root node attributes
+            Att("import"),
+            Att("class"),
+            Att("sizes"),
+            Att("genclass",
+               FEnum([
+                  SamHaXeModule.GENCLASS_FALSE, 
+                  SamHaXeModule.GENCLASS_SYMBOL_ONLY, 
+                  SamHaXeModule.GENCLASS_SYMBOL_AND_CLASS
+               ]), 
+               SamHaXeModule.GENCLASS_SYMBOL_AND_CLASS
+            ),
+            Att("mode", FEnum(["bitmap", "sdf"]), "bitmap"),
+            Att("spread", FInt, "4"),
+            Att("padding", FInt, "1"),
+         ],
+
+         // Child nodes
+         characters_rule(ns)
+      );
+
+      haxe.xml.Check.checkNode(atlas.x, atlas_rule);
+
+      parse_pixel_sizes(atlas.att.sizes);
+
+      var spread = Std.parseInt(atlas.att.spread);
+      if(spread < 1 || spread > 255)
+         throw "Invalid spread attribute: '" + atlas.att.spread + "'. Spread should be between 1 and 255!";
+
+      if(Std.parseInt(atlas.att.padding) < 0)
+         throw "Invalid padding attribute: '" + atlas.att.padding + "'. Padding should not be negative!";
+
+      check_characters(atlas);
    }
    
    public function import_font_1_0(font_node: NsFastXml, options: Hash<String>): Array<SWFTag> {
+      if(font_node.lname == "atlas")
+         return import_atlas(font_node);
+
       var swf_ver = moduleService_1_0.getFlashVersion();
       if(swf_ver < 3)
          throw "The minimum flash version for dynamic glyph text is 3!";
 
-      var import_font_fn = neko.Lib.load("font", "import_font", 3);
+      var import_font_fn = neko.Lib.load("font", "import_font", 5);
       var font_file = font_node.x.get("import");
       var font_name = font_node.att.name;
       
@@ -214,19 +459,28 @@ class Font {
          should_gen_class || font_node.att.genclass == SamHaXeModule.GENCLASS_SYMBOL_ONLY;
 
       var swf_em: Int = if(swf_ver < 9) 1024 else 1024 * 20;
+      var optimize = font_node.att.tolerance.length > 0;
       var font: NativeFontData = null;
       
       try {
          font = neko.Lib.nekoToHaxe(import_font_fn(
             untyped font_file.__s,
             if(font_node.hasLNode.characters) neko.Lib.haxeToNeko(build_charcode_vector(font_node)) else null,
-            swf_em
+            swf_em,
+            // Negative tolerance turns off outline optimization
+            if(optimize) Std.parseFloat(font_node.att.tolerance) else -1.0,
+            Std.parseFloat(font_node.att.grid)
          ));
       }
       catch (e : Dynamic) {
          throw "Could not open file '" + font_file + "', reason:\n" + Helpers.tabbed(e.toString());
       }
 
+      // TODO: use logger service
+      if(optimize)
+         neko.Lib.print("[INFO] font '" + font_name + "': glyph shapes optimized from " +
+            font.original_shape_bytes + " to " + font.shape_bytes + " bytes.\n");
+
       var glyphs = new Array<Font2GlyphData>();
       var glyph_layout = new Array<FontLayoutGlyphData>();
 
@@ -386,6 +640,181 @@ class Font {
       ];
    }
 
+
+   function parse_pixel_sizes(sizes: String): Array<Int> {
+      var result = new Array<Int>();
+
+      for(s in sizes.split(",")) {
+         var size = Std.parseInt(StringTools.trim(s));
+
+         if(size == null || size < 1 || size > 2048)
+            throw "Invalid size '" + s + "' in sizes attribute: '" + sizes + "'. Sizes should be in the 1..2048 range!";
+
+         for(other in result)
+            if(other == size)
+               throw "Duplicate size '" + s + "' in sizes attribute: '" + sizes + "'!";
+
+         result.push(size);
+      }
+
+      return result;
+   }
+
+   /*
+      Registers a symbol and generates a class stub for an atlas asset.
+      Returns the character id of the asset or null if it is already imported.
+   */
+   function register_atlas_asset(hash_base: String, tag_id: Int, class_name: String, superclass_name: String,
+                                 should_gen_class: Bool, should_store_symbol: Bool): Null<Int> {
+      var as3Reg = moduleService_1_0.getAS3Registry();
+      var hashIdRes = Helpers.getIdForHashSymbolWarn(
+         hash_base,
+         tag_id,
+         moduleService_1_0.getIdRegistry(),
+         moduleService_1_0.getSymbolRegistry(),
+         class_name,
+         should_store_symbol
+      );
+
+      return switch (hashIdRes) {
+         case HISWR_SkipOk:
+            null;
+
+         case HISWR_DataFound(id):
+            if (should_gen_class)
+               Helpers.generateClass(as3Reg, class_name, superclass_name);
+            null;
+
+         case HISWR_New(id):
+            if (should_gen_class)
+               Helpers.generateClass(as3Reg, class_name, superclass_name);
+            id;
+
+         case HISWR_NewOnlyData(id):
+            id;
+      }
+   }
+
+   function build_atlas_metrics(atlas: NativeAtlasData, sdf: Bool, spread: Int): haxe.io.Bytes {
+      var o = new haxe.io.BytesOutput();
+      o.bigEndian = false;
+
+      o.writeUInt16(ATLAS_METRICS_VERSION);
+      o.writeByte(if(sdf) 1 else 0);
+      o.writeByte(if(sdf) spread else 0);
+      o.writeUInt16(atlas.width);
+      o.writeUInt16(atlas.height);
+      o.writeUInt16(atlas.sizes.length);
+
+      for(size in atlas.sizes) {
+         o.writeUInt16(size.size);
+         o.writeInt16(size.ascent);
+         o.writeInt16(size.descent);
+         o.writeInt16(size.height);
+
+         o.writeUInt30(size.glyphs.length);
+         for(g in size.glyphs) {
+            o.writeUInt30(g.char_code);
+            o.writeUInt16(g.x);
+            o.writeUInt16(g.y);
+            o.writeUInt16(g.width);
+            o.writeUInt16(g.height);
+            o.writeInt16(g.left);
+            o.writeInt16(g.top);
+            o.writeInt16(g.advance);
+         }
+
+         o.writeUInt30(size.kerning.length);
+         for(k in size.kerning) {
+            o.writeUInt30(k.left_char);
+            o.writeUInt30(k.right_char);
+            o.writeInt16(k.x);
+         }
+      }
+
+      return o.getBytes();
+   }
+
+   function import_atlas(atlas_node: NsFastXml): Array<SWFTag> {
+      var flash_version = moduleService_1_0.getFlashVersion();
+      if(flash_version < 9)
+         throw "Importing glyph atlases requires flash version 9 or higher!";
+
+      var render_atlas_fn = neko.Lib.load("font", "render_atlas", 4);
+      var font_file = atlas_node.x.get("import");
+      var sizes = parse_pixel_sizes(atlas_node.att.sizes);
+      var sdf = atlas_node.att.mode == "sdf";
+      var spread = Std.parseInt(atlas_node.att.spread);
+      var padding = Std.parseInt(atlas_node.att.padding);
+
+      var package_name = moduleService_1_0.getVariableRegistry().getVariable("package");
+      var class_name = ((package_name.length > 0) ? package_name + "." : "") + atlas_node.x.get("class");
+      var metrics_class_name = class_name + "Metrics";
+
+      var should_gen_class = !atlas_node.has.genclass || atlas_node.att.genclass == SamHaXeModule.GENCLASS_SYMBOL_AND_CLASS;
+      var should_store_symbol = should_gen_class || atlas_node.att.genclass == SamHaXeModule.GENCLASS_SYMBOL_ONLY;
+
+      var atlas: NativeAtlasData = null;
+      try {
+         atlas = neko.Lib.nekoToHaxe(render_atlas_fn(
+            untyped font_file.__s,
+            if(atlas_node.hasLNode.characters) neko.Lib.haxeToNeko(build_charcode_vector(atlas_node)) else null,
+            neko.Lib.haxeToNeko(sizes),
+            {
+               spread:     if(sdf) spread else 0,
+               padding:    padding,
+               max_size:   if(flash_version < 10) ATLAS_MAX_SIZE_9 else ATLAS_MAX_SIZE_10
+            }
+         ));
+      }
+      catch (e : Dynamic) {
+         throw "Could not render glyph atlas from file '" + font_file + "', reason:\n" + Helpers.tabbed(e.toString());
+      }
+
+      if(flash_version >= 10 && atlas.width * atlas.height > ATLAS_MAX_PIXELS_10)
+         throw "Glyph atlas of " + atlas.width + "x" + atlas.height + " pixels exceeds the maximum bitmap area of " +
+            ATLAS_MAX_PIXELS_10 + " pixels! Use less characters or sizes.";
+
+      moduleService_1_0.getDependencyRegistry().addFilePath(font_file);
+
+      var tags = new Array<SWFTag>();
+
+      // Glyph bitmap
+      var bitmap_data = haxe.io.Bytes.ofString(atlas.data);
+      var bitmap_cid = register_atlas_asset(
+         Std.string(CM32Bits) + Std.string(atlas.width) + Std.string(atlas.height) + bitmap_data.toString(),
+         TagId.DefineBitsLossless2,
+         class_name,
+         atlas_superclass,
+         should_gen_class,
+         should_store_symbol
+      );
+
+      if(bitmap_cid != null)
+         tags.push(TBitsLossless2({
+            cid:     bitmap_cid,
+            color:   CM32Bits,
+            width:   atlas.width,
+            height:  atlas.height,
+            data:    format.tools.Deflate.run(bitmap_data)
+         }));
+
+      // Metrics and kerning table
+      var metrics_data = build_atlas_metrics(atlas, sdf, spread);
+      var metrics_cid = register_atlas_asset(
+         metrics_data.toString(),
+         TagId.DefineBinaryData,
+         metrics_class_name,
+         atlas_metrics_superclass,
+         should_gen_class,
+         should_store_symbol
+      );
+
+      if(metrics_cid != null)
+         tags.push(TBinaryData(metrics_cid, metrics_data));
+
+      return tags;
+   }
    
    public function help_font_1_0(): String {
       return
@@ -405,10 +834,19 @@ class Font {
       - simpleChinese
       - traditionalChinese
 
+    tolerance - Turns on glyph outline optimization: degenerate edges are dropped, curves deviating less
+                than tolerance from a straight line become lines and (nearly) collinear lines are merged.
+                Measured in 1/1024 em units, 0 keeps the outlines intact. A curve turned into a line may
+                be merged with collinear lines afterwards, so the outline can move by up to 2 times the
+                tolerance. The glyph shape sizes before and after the optimization are reported.
+
+    grid      - Relevant only if tolerance is set. Snaps every outline point to a grid of the given size
+                (in 1/1024 em units). Default is 0 (no snapping).
+
   Child nodes:
-    <ttf> has only one child node so far: <characters> which has two other optional child nodes
+    <ttf> has only one child node so far: <characters> which has three other optional child nodes
     <include> and <exclude> for specifying indivudal characters or character ranges to import / omit
-      respectively.
+      respectively and <corpus> for including every character used in a set of text files.
     If <ttf> does not have any child nodes then every character which appear in the file are imported.
 
     <include> (child of <characters>): Specifies a character set or character range to include.
@@ -423,6 +861,16 @@ class Font {
        range      - Range of characters in the form: firstCharacter..lastCharacter
        characters - Individual characters in arbitrary order
 
+     <corpus> (child of <characters>): Includes every character which appears in the given UTF-8 encoded
+       text files. Applied in document order like <include> and <exclude>.
+
+     Mandatory attributes:
+       path - Path to a text file or to a directory which is scanned recursively. Files and directories
+              whose name starts with a dot (e.g. .svn) are skipped.
+
+     Optional attributes:
+       glob - Comma separated list of file name patterns (*, ? wildcards). Mandatory if path is a directory.
+
   Example:
     Assuming that Font import module is assigned to namespace _font_ the following snippet imports
     the even numbers and the letters _abxyz_ from _arial.ttf_ and names the font _Arial_.
@@ -433,13 +881,132 @@ class Font {
             <font:exclude characters="13579"/>
             <font:include characters="abxyz"/>
          </font:characters>
-      </font:ttf>';
+      </font:ttf>
+
+  <atlas>: Renders the specified glyphs of a TrueType font file to a DefineBitsLossless2 swf tag and stores
+    the glyph positions, metrics and kerning in a DefineBinaryData swf tag. Requires flash version 9 or higher.
+
+  Mandatory attributes:
+    import - Path to the file to be imported.
+    class  - Class name assigned to the glyph bitmap. The metrics table gets the same class name with a
+             Metrics suffix.
+    sizes  - Comma separated list of pixel sizes to render the glyphs at.
+
+  Optional attributes:
+    mode     - Rendering mode.
+      - bitmap (default) anti-aliased glyph bitmaps
+      - sdf              signed distance fields
+    spread   - Relevant only for signed distance fields. The distance in pixels mapped to the full 0..255
+               range (1..255, default: 4). The edge of the glyphs is at value 128. The distances are
+               computed from the glyphs rendered at 4 times the requested size.
+    padding  - Empty pixels between the glyphs in the bitmap (default: 1).
+    genclass - Controls the generation of symbols and AS3 class stubs.
+      false          - do not generate neither symbol nor AS3 class stub
+      symbolOnly     - generate only symbol
+      symbolAndClass - generate symbol and AS3 class stub
+
+  Child nodes:
+    The same <characters> node as in case of <ttf>.
+
+  Superclass:
+    flash.display.Bitmap  - The superclass of the glyph bitmap class stub.
+    flash.utils.ByteArray - The superclass of the metrics table class stub (little endian, see the
+                            documentation for the format). A reader class is shipped as
+                            demos/FontAtlasDemo/FontAtlasMetrics.hx.
+
+  Bitmap limits:
+    The glyph bitmap can't be larger than 2880x2880 pixels for flash 9, 8191x8191 pixels and
+    16777215 pixels in total for flash 10 and above. Glyphs are always rendered from outlines.
+
+  Example:
+      <font:atlas import="arial.ttf" class="resources.Digits" sizes="32" mode="sdf" spread="6">
+         <font:characters>
+            <font:include range="0..9"/>
+         </font:characters>
+      </font:atlas>';
    }
    
+   function glob_to_ereg(glob: String): EReg {
+      var patterns = new Array<String>();
+      for(part in glob.split(",")) {
+         var g = StringTools.trim(part);
+         var p = new StringBuf();
+         for(i in 0...g.length) {
+            var c = g.charAt(i);
+            p.add(switch(c) {
+               case "*": ".*";
+               case "?": ".";
+               case ".", "+", "(", ")", "[", "]", "{", "}", "^", "$", "|", "\\": "\\" + c;
+               default: c;
+            });
+         }
+         patterns.push(p.toString());
+      }
+
+      return new EReg("^(" + patterns.join("|") + ")$", "");
+   }
+
+   function collect_corpus_files(path: String, filter: EReg, files: Array<String>, visited: Hash<Bool>) {
+      if(!neko.FileSystem.isDirectory(path)) {
+         files.push(path);
+         return;
+      }
+
+      // Symlinked directories may form cycles, visit every directory only once.
+      // Inode numbers are not available on every platform (0 on Windows).
+      var stat = neko.FileSystem.stat(path);
+      if(stat.ino != 0) {
+         var key = stat.dev + ":" + stat.ino;
+         if(visited.exists(key))
+            return;
+         visited.set(key, true);
+      }
+
+      var entries = neko.FileSystem.readDirectory(path);
+      entries.sort(Reflect.compare);
+
+      for(e in entries) {
+         // Skip hidden entries (.svn, .git, ...)
+         if(e.charAt(0) == ".")
+            continue;
+
+         var p = path + "/" + e;
+         if(neko.FileSystem.isDirectory(p))
+            collect_corpus_files(p, filter, files, visited);
+         else if(filter.match(e))
+            files.push(p);
+      }
+   }
+
+   function corpus_charcodes(corpus: NsFastXml): Array<Int> {
+      var corpus_char_codes_fn = neko.Lib.load("font", "corpus_char_codes", 1);
+      var files = new Array<String>();
+      collect_corpus_files(corpus.att.path, glob_to_ereg(corpus.att.glob), files, new Hash<Bool>());
+
+      var codes: Array<Int> = null;
+      try {
+         codes = neko.Lib.nekoToHaxe(corpus_char_codes_fn(neko.Lib.haxeToNeko(files)));
+      }
+      catch (e : Dynamic) {
+         throw "Could not scan corpus '" + corpus.att.path + "', reason:\n" + Helpers.tabbed(e.toString());
+      }
+
+      for(f in files)
+         moduleService_1_0.getDependencyRegistry().addFilePath(f);
+
+      return codes;
+   }
+
    function build_charcode_vector(font: NsFastXml): Array<Int> {
       var h = new IntHash<Bool>();
       for(n in font.lnode.characters.elements) {
-         var set: Bool = (n.lname == "include");
+         var set: Bool = (n.lname != "exclude");
+
+         if(n.lname == "corpus") {
+            for(code in corpus_charcodes(n))
+               h.set(code, set);
+            continue;
+         }
          
          if(n.has.range && n.att.range.length > 0) {
             var from_char = neko.Utf8.charCodeAt(n.att.range, 0);
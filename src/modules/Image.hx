@@ -21,6 +21,10 @@
             *symbolAndClass* (generate symbol and AS3 class stub)
       mask - Relevant only for JPEGs ignored for lossless images. Path to the file containing the alpha mask.
              The dimensions of the image file and mask file has to be identical.
+      scales - Comma separated list of scale factors in the (0, 1] range. The image is decoded only once and
+             every scale becomes a separate lossless image (downscaled with a box filter). Scale 1 keeps the
+             class name, the other variants get the scale as suffix (e.g. _0_5 for 0.5). JPEG files are
+             imported as lossless images too and mask is ignored if this attribute is present.
 
    Superclass:
       flash.display.Bitmap - The superclass of the AS3 class stub.
@@ -34,8 +38,13 @@
    Exampe 2:
       Import a JPEG file with an alpha mask:
       > <img:image import="background.jpg" mask="vignette.png" class="resources.BgImage"/>
-   
+
    Example 3:
+      Import a full, a half and a quarter sized variant of an image as _resources.Logo_,
+      _resources.Logo_0_5_ and _resources.Logo_0_25_:
+      > <img:image import="logo.png" scales="1,0.5,0.25" class="resources.Logo"/>
+   
+   Example 4:
       Manual creation of class stub. First import the image file with _genclass_ set to _symbolOnly_
       > <img:image import="texture.jpg" class="resources.FloorTexture" genclass="symbolOnly"/>
       then define the class stub in haXe:
@@ -59,6 +68,11 @@ import SamHaXeModule;
 import Helpers;
 import ModuleService;
 
+typedef ImageScale = {
+   var value: Float;
+   var text: String;
+}
+
 class Image {
    static var interface_versions = ["1.0.0"];
    
@@ -86,15 +100,23 @@ class Image {
             SamHaXeModule.GENCLASS_SYMBOL_AND_CLASS
          ),  
          Att("mask", null, ""),
+         Att("scales", null, ""),
       ]);
 
       haxe.xml.Check.checkNode(image.x, image_rule);
+
+      if(image.has.scales && image.att.scales.length > 0)
+         parse_scales(image.att.scales);
    }
    
    public function import_image_1_0(image: NsFastXml, options: Hash<String>): Array<SWFTag> {
       var file_name = image.x.get("import");
       var lname = file_name.toLowerCase();
 
+      if(image.has.scales && image.att.scales.length > 0)
+         // Scaled variants are always resampled from the decoded pixels
+         return load_lossless_scaled(image);
+
       if(lname.lastIndexOf(".jpg") == lname.length - 4 || lname.lastIndexOf(".jpeg") == lname.length - 5) {
          // Use JPEG import if the file extension is '.jpg' or '.jpeg'
          return load_jpeg(image);
@@ -123,6 +145,11 @@ class Image {
     mask - Relevant only for JPEGs ignored for lossless images. Path to the file containing the alpha mask.
            The dimensions of the image file and mask file has to be identical.
 
+    scales - Comma separated list of scale factors in the (0, 1] range. The image is decoded only once and
+             every scale becomes a separate lossless image (downscaled with a box filter). Scale 1 keeps the
+             class name, the other variants get the scale as suffix (e.g. _0_5 for 0.5). JPEG files are
+             imported as lossless images too and mask is ignored if this attribute is present.
+
   Superclass:
     flash.display.Bitmap - The superclass of the AS3 class stub.
 
@@ -137,8 +164,14 @@ class Image {
       Import a JPEG file with an alpha mask:
         
         <img:image import="background.jpg" mask="vignette.png" class="resources.BgImage"/>
-   
+
    Example 3:
+      Import a full, a half and a quarter sized variant of an image as resources.Logo,
+      resources.Logo_0_5 and resources.Logo_0_25:
+
+        <img:image import="logo.png" scales="1,0.5,0.25" class="resources.Logo"/>
+   
+   Example 4:
       Manual creation of class stub. First import the image file with genclass set to symbolOnly
 
         <img:image import="texture.jpg" class="resources.FloorTexture" genclass="symbolOnly"/>
@@ -347,6 +380,28 @@ class Image {
       }
    }
 
+   function parse_scales(scales: String): Array<ImageScale> {
+      var result = new Array<ImageScale>();
+      // Plain decimal numbers only, so the text can be used in class names
+      var number = ~/^([0-9]+(\.[0-9]*)?|\.[0-9]+)$/;
+
+      for(s in scales.split(",")) {
+         var text = StringTools.trim(s);
+         var scale = if(number.match(text)) Std.parseFloat(text) else Math.NaN;
+
+         if(Math.isNaN(scale) || scale <= 0 || scale > 1)
+            throw "Invalid scale '" + s + "' in scales attribute: '" + scales + "'. Scales should be decimal numbers in the (0, 1] range!";
+
+         for(other in result)
+            if(other.value == scale)
+               throw "Duplicate scale '" + s + "' in scales attribute: '" + scales + "'!";
+
+         result.push({ value: scale, text: text });
+      }
+
+      return result;
+   }
+
    function load_lossless(image: NsFastXml): Array<SWFTag> {
       var image_file = image.x.get("import");
       var import_fn = neko.Lib.load("image", "import_image", 1);
@@ -358,6 +413,41 @@ class Image {
          throw "Could not import file '" + image_file + "', reason:\n" + Helpers.tabbed(e.toString());
       }
 
+      return build_lossless(image, img, image.x.get("class"));
+   }
+
+   function load_lossless_scaled(image: NsFastXml): Array<SWFTag> {
+      var image_file = image.x.get("import");
+      var scales = parse_scales(image.att.scales);
+      var import_fn = neko.Lib.load("image", "import_image_scaled", 2);
+      var scale_values = new Array<Float>();
+      for(s in scales)
+         scale_values.push(s.value);
+
+      var imgs: Array<Dynamic> = null;
+      try {
+         imgs = neko.NativeArray.toArray(import_fn(untyped image_file.__s, neko.Lib.haxeToNeko(scale_values)));
+      }
+      catch (e : Dynamic) {
+         throw "Could not import file '" + image_file + "', reason:\n" + Helpers.tabbed(e.toString());
+      }
+
+      var tags = new Array<SWFTag>();
+      for(i in 0...scales.length) {
+         // The unscaled variant keeps the class name, the others get the scale as suffix (eg. 0.5 -> Flower_0_5)
+         var class_name = image.x.get("class");
+         if(scales[i].value != 1)
+            class_name += "_" + StringTools.replace(scales[i].text, ".", "_");
+
+         tags = tags.concat(build_lossless(image, imgs[i], class_name));
+      }
+
+      return tags;
+   }
+
+   function build_lossless(image: NsFastXml, img: Dynamic, cls_name: String): Array<SWFTag> {
+      var image_file = image.x.get("import");
+
       if(img.alpha) {
          if(moduleService_1_0.getFlashVersion() < 3)
             throw "Importing lossless images with alpha channel requires flash version 3 or higher!";
@@ -381,7 +471,7 @@ class Image {
       var should_store_symbol = should_gen_class || image.att.genclass == SamHaXeModule.GENCLASS_SYMBOL_ONLY;
 
       var package_name = moduleService_1_0.getVariableRegistry().getVariable("package");
-      var class_name = (if(package_name.length > 0) package_name + "." else "") + image.x.get("class");
+      var class_name = (if(package_name.length > 0) package_name + "." else "") + cls_name;
       var as3Reg = moduleService_1_0.getAS3Registry();
       var symReg = moduleService_1_0.getSymbolRegistry();
 
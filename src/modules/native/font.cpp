@@ -1,6 +1,15 @@
 #include <stdio.h>
+#include <math.h>
 #include <neko.h>
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include <vector>
 #include <algorithm>
 
@@ -9,6 +18,9 @@
 #include FT_GLYPH_H
 #include FT_OUTLINE_H
 
+// Size of the error message buffers (long file paths are truncated)
+#define ERROR_SIZE 1024
+
 enum {
    PT_MOVE = 1,
    PT_LINE = 2,
@@ -28,6 +40,7 @@ struct glyph {
    FT_Vector               advance;
    FT_Glyph_Metrics        metrics;
    int                     index, x, y;
+   int                     min_x, max_x, min_y, max_y;
    std::vector<int>        pts;
 
    glyph(): x(0), y(0) { }
@@ -93,15 +106,437 @@ int outline_cubic_to(const FT_Vector *ctl1, const FT_Vector *ctl2, const FT_Vect
    return 1;
 }
 
+struct segment {
+   unsigned char  type;
+   int            cx, cy;
+   int            x, y;
+
+   segment() { }
+   segment(unsigned char type, int cx, int cy, int x, int y): type(type), cx(cx), cy(cy), x(x), y(y) { }
+};
+
+// Number of bits needed to store the absolute value (mirrors format.swf.Tools.minBits).
+static int min_bits(int v) {
+   int         n = 0;
+
+   if(v < 0)
+      v = -v;
+   while(v != 0) {
+      n++;
+      v >>= 1;
+   }
+
+   return n;
+}
+
+// Number of bits of a signed edge delta field (at least 2, see format.swf.Writer.writeShapeRecord).
+static int edge_bits(int a, int b, int c = 0, int d = 0) {
+   int         mb = min_bits(a);
+
+   mb = std::max(mb, min_bits(b));
+   mb = std::max(mb, min_bits(c));
+   mb = std::max(mb, min_bits(d)) + 1;
+
+   return mb < 2 ? 2 : mb;
+}
+
+// Size of a glyph in bytes once written as SHAPE record list into DefineFont2 / DefineFont3.
+static int outline_shape_bytes(const std::vector<int> &pts) {
+   int         bits = 0;
+   bool        first_move = true;
+   int         i = 0, n = pts.size();
+
+   while(i < n) {
+      switch(pts[i++]) {
+         case PT_MOVE: {
+            int      mb = std::max(min_bits(pts[i]), min_bits(pts[i + 1])) + 1;
+
+            // Flags, move bits, coordinates and the fill style of the first move
+            bits += 6 + 5 + 2 * mb + (first_move ? 1 : 0);
+            first_move = false;
+            i += 2;
+            break;
+         }
+
+         case PT_LINE: {
+            int      dx = pts[i], dy = pts[i + 1];
+            int      mb = edge_bits(dx, dy);
+
+            bits += 2 + 4 + 1 + (dx != 0 && dy != 0 ? 2 * mb : 1 + mb);
+            i += 2;
+            break;
+         }
+
+         case PT_CURVE:
+            bits += 2 + 4 + 4 * edge_bits(pts[i], pts[i + 1], pts[i + 2], pts[i + 3]);
+            i += 4;
+            break;
+
+         default:
+            return 0;
+      }
+   }
+
+   // End record, fill and line bit counts are stored in an extra byte
+   bits += 6;
+
+   return 1 + (bits + 7) / 8;
+}
+
+static void decode_outline(const std::vector<int> &pts, std::vector<segment> &segs) {
+   int         x = 0, y = 0;
+   int         i = 0, n = pts.size();
+
+   while(i < n) {
+      switch(pts[i++]) {
+         case PT_MOVE:
+            x = pts[i];
+            y = pts[i + 1];
+            segs.push_back(segment(PT_MOVE, 0, 0, x, y));
+            i += 2;
+            break;
+
+         case PT_LINE:
+            x += pts[i];
+            y += pts[i + 1];
+            segs.push_back(segment(PT_LINE, 0, 0, x, y));
+            i += 2;
+            break;
+
+         case PT_CURVE: {
+            int      cx = x + pts[i];
+            int      cy = y + pts[i + 1];
+
+            x = cx + pts[i + 2];
+            y = cy + pts[i + 3];
+            segs.push_back(segment(PT_CURVE, cx, cy, x, y));
+            i += 4;
+            break;
+         }
+      }
+   }
+}
+
+static void encode_outline(const std::vector<segment> &segs, std::vector<int> &pts) {
+   int         x = 0, y = 0;
+   int         i;
+
+   pts.clear();
+   for(i = 0; i < segs.size(); i++) {
+      const segment  &s = segs[i];
+
+      pts.push_back(s.type);
+      switch(s.type) {
+         case PT_MOVE:
+            pts.push_back(s.x);
+            pts.push_back(s.y);
+            break;
+
+         case PT_LINE:
+            pts.push_back(s.x - x);
+            pts.push_back(s.y - y);
+            break;
+
+         case PT_CURVE:
+            pts.push_back(s.cx - x);
+            pts.push_back(s.cy - y);
+            pts.push_back(s.x - s.cx);
+            pts.push_back(s.y - s.cy);
+            break;
+      }
+
+      x = s.x;
+      y = s.y;
+   }
+}
+
+// Distance of (px, py) from the line through (ax, ay) and (bx, by).
+static double line_distance(int px, int py, int ax, int ay, int bx, int by) {
+   double      dx = bx - ax, dy = by - ay;
+   double      len = sqrt(dx * dx + dy * dy);
+
+   if(len == 0.0)
+      return sqrt((double)(px - ax) * (px - ax) + (double)(py - ay) * (py - ay));
+
+   return fabs(dx * (py - ay) - dy * (px - ax)) / len;
+}
+
+// Distance of a point from the line segment between (ax, ay) and (bx, by).
+static double segment_distance(int px, int py, int ax, int ay, int bx, int by) {
+   double      dx = bx - ax, dy = by - ay;
+   double      len2 = dx * dx + dy * dy;
+   double      t = len2 == 0.0 ? 0.0 : ((px - ax) * dx + (py - ay) * dy) / len2;
+
+   if(t < 0.0)
+      t = 0.0;
+   else if(t > 1.0)
+      t = 1.0;
+
+   double      qx = ax + t * dx - px, qy = ay + t * dy - py;
+
+   return sqrt(qx * qx + qy * qy);
+}
+
+// Checks whether every point of a run of lines starting at (sx, sy) is within tolerance of the
+// straight line from (sx, sy) to (ex, ey), without going backwards along the way.
+static bool lines_mergeable(const std::vector<segment> &run, int sx, int sy, int ex, int ey, double tolerance) {
+   double      dx = ex - sx, dy = ey - sy;
+   double      len2 = dx * dx + dy * dy;
+   int         i;
+
+   if(len2 == 0.0)
+      return false;
+
+   for(i = 0; i < run.size(); i++) {
+      double   t = ((run[i].x - sx) * dx + (run[i].y - sy) * dy) / len2;
+
+      if(t < 0.0 || t > 1.0 || line_distance(run[i].x, run[i].y, sx, sy, ex, ey) > tolerance)
+         return false;
+   }
+
+   return true;
+}
+
+static int snap(int v, double grid) {
+   return (int)floor(floor(v / grid + 0.5) * grid + 0.5);
+}
+
+// Simplifies the outline of a glyph: snaps the points to the grid (if grid > 0), drops degenerate
+// segments, converts curves deviating less than tolerance from their chord to lines and merges runs
+// of (nearly) collinear lines.
+static void optimize_outline(std::vector<int> &pts, double tolerance, double grid) {
+   std::vector<segment>    segs, out, run;
+   int                     px = 0, py = 0;
+   int                     i;
+
+   decode_outline(pts, segs);
+
+   for(i = 0; i <= segs.size(); i++) {
+      segment     s;
+      
+      if(i < segs.size()) {
+         // Current point is the end of the pending lines if any
+         int      ex = run.empty() ? px : run.back().x;
+         int      ey = run.empty() ? py : run.back().y;
+
+         s = segs[i];
+
+         if(grid > 0.0) {
+            s.cx = snap(s.cx, grid);
+            s.cy = snap(s.cy, grid);
+            s.x = snap(s.x, grid);
+            s.y = snap(s.y, grid);
+         }
+
+         if(s.type == PT_CURVE &&
+            // The curve deviates from its chord by half of the control point distance at most. The
+            // distance is measured from the chord segment, not the infinite line, as a control point
+            // beyond an end point makes the curve overshoot that end.
+            segment_distance(s.cx, s.cy, ex, ey, s.x, s.y) / 2 <= tolerance)
+            s.type = PT_LINE;
+
+         if(s.type == PT_LINE) {
+            if(s.x == ex && s.y == ey)
+               continue;
+
+            if(lines_mergeable(run, px, py, s.x, s.y, tolerance)) {
+               run.push_back(s);
+               continue;
+            }
+         }
+      }
+
+      // Flush pending lines
+      if(!run.empty()) {
+         out.push_back(run.back());
+         px = run.back().x;
+         py = run.back().y;
+         run.clear();
+      }
+
+      if(i == segs.size())
+         break;
+
+      if(s.type == PT_LINE) {
+         run.push_back(s);
+         continue;
+      }
+
+      // Contours without any edge are left out
+      if(s.type == PT_MOVE && !out.empty() && out.back().type == PT_MOVE)
+         out.pop_back();
+
+      out.push_back(s);
+      px = s.x;
+      py = s.y;
+   }
+
+   if(!out.empty() && out.back().type == PT_MOVE)
+      out.pop_back();
+
+   encode_outline(out, pts);
+}
+
+// Computes the bounding box of every anchor and control point of an outline. Returns false
+// if the outline has no points.
+static bool outline_bounds(const std::vector<int> &pts, int &min_x, int &max_x, int &min_y, int &max_y) {
+   std::vector<segment>    segs;
+   int                     i;
+
+   decode_outline(pts, segs);
+   if(segs.empty())
+      return false;
+
+   min_x = max_x = segs[0].x;
+   min_y = max_y = segs[0].y;
+   for(i = 0; i < segs.size(); i++) {
+      const segment  &sg = segs[i];
+
+      min_x = std::min(min_x, sg.x);
+      max_x = std::max(max_x, sg.x);
+      min_y = std::min(min_y, sg.y);
+      max_y = std::max(max_y, sg.y);
+
+      if(sg.type == PT_CURVE) {
+         min_x = std::min(min_x, sg.cx);
+         max_x = std::max(max_x, sg.cx);
+         min_y = std::min(min_y, sg.cy);
+         max_y = std::max(max_y, sg.cy);
+      }
+   }
+
+   return true;
+}
+
 static FT_Library    ft;
 
+// Marks every code point of an UTF-8 encoded buffer as used. Invalid sequences are skipped.
+static void decode_utf8(const unsigned char *p, const unsigned char *end, std::vector<bool> &used) {
+   while(p < end) {
+      unsigned int      c = *p++;
+      int               len;
+
+      // Fast path for ASCII runs
+      if(c < 0x80) {
+         used[c] = true;
+         continue;
+      }
+
+      if((c & 0xe0) == 0xc0) {
+         len = 1;
+         c &= 0x1f;
+      } else if((c & 0xf0) == 0xe0) {
+         len = 2;
+         c &= 0x0f;
+      } else if((c & 0xf8) == 0xf0) {
+         len = 3;
+         c &= 0x07;
+      } else
+         // Stray continuation byte or invalid lead byte
+         continue;
+
+      int               i;
+      for(i = 0; i < len && p + i < end && (p[i] & 0xc0) == 0x80; i++)
+         c = (c << 6) | (p[i] & 0x3f);
+
+      if(i < len) {
+         // Truncated sequence (also at the end of the buffer), resync at the offending byte
+         p += i;
+         continue;
+      }
+      p += len;
+
+      // Reject overlong encodings, surrogates and out of range values
+      static const unsigned int  min_value[4] = { 0, 0x80, 0x800, 0x10000 };
+      if(c < min_value[len] || c > 0x10ffff || (c >= 0xd800 && c <= 0xdfff))
+         continue;
+
+      used[c] = true;
+   }
+}
+
+// Collects the character codes used in the given files. Returns NULL and fills error (of
+// at least ERROR_SIZE bytes) on failure, so the caller can throw without live C++ objects
+// on the stack (val_throw never returns).
+static value collect_corpus_char_codes(value *fa, int num_files, char *error) {
+   std::vector<bool>          used(0x110000, false);
+   std::vector<unsigned char> buf;
+   int                        i;
+
+   for(i = 0; i < num_files; i++) {
+      FILE     *f = fopen(val_string(fa[i]), "rb");
+      if(f == NULL) {
+         sprintf(error, "File open error: '%.*s'!", ERROR_SIZE - 32, val_string(fa[i]));
+         return NULL;
+      }
+
+      fseek(f, 0, SEEK_END);
+      long     size = ftell(f);
+      fseek(f, 0, SEEK_SET);
+
+      if(size < 0) {
+         fclose(f);
+         sprintf(error, "File read error: '%.*s'!", ERROR_SIZE - 32, val_string(fa[i]));
+         return NULL;
+      }
+
+      buf.resize(size > 0 ? size : 1);
+      size_t   read = fread(&buf[0], 1, size, f);
+      fclose(f);
+
+      decode_utf8(&buf[0], &buf[0] + read, used);
+   }
+
+   // Control characters and the byte order mark never need a glyph
+   for(i = 0; i < 0x20; i++)
+      used[i] = false;
+   used[0x7f] = false;
+   used[0xfeff] = false;
+
+   std::vector<int>     codes;
+   for(i = 0; i < 0x110000; i++)
+      if(used[i])
+         codes.push_back(i);
+
+   int               num_codes = codes.size();
+   value             ret = alloc_array(num_codes);
+   value             *ra = val_array_ptr(ret);
+
+   for(i = 0; i < num_codes; i++)
+      ra[i] = alloc_int(codes[i]);
+
+   return ret;
+}
+
+value corpus_char_codes(value files) {
+   int               i, num_files;
+   value             *fa;
+   char              error[ERROR_SIZE];
+
+   val_check(files, array);
+
+   num_files = val_array_size(files);
+   fa = val_array_ptr(files);
+
+   for(i = 0; i < num_files; i++)
+      val_check(fa[i], string);
+
+   value             ret = collect_corpus_char_codes(fa, num_files, error);
+   if(ret == NULL) {
+      val_throw(alloc_string(error));
+      return val_null;
+   }
+
+   return ret;
+}
+
 value init() {
    int      result = FT_Init_FreeType(&ft);
 
    return alloc_bool(result == 0);
 }
 
-value import_font(value font_file, value char_vector, value em_size) {
+value import_font(value font_file, value char_vector, value em_size, value tolerance_value, value grid_value) {
    FT_Face           face;
    int               result, i, j;
 
@@ -109,6 +544,8 @@ value import_font(value font_file, value char_vector, value em_size) {
    if(!val_is_null(char_vector))
       val_check(char_vector, array);
    val_check(em_size, int);
+   val_check(tolerance_value, number);
+   val_check(grid_value, number);
 
    result = FT_New_Face(ft, val_string(font_file), 0, &face);
    if (result == FT_Err_Unknown_File_Format) {
@@ -191,6 +628,37 @@ value import_font(value font_file, value char_vector, value em_size) {
    // Ascending sort by character codes
    std::sort(glyphs.begin(), glyphs.end(), glyph_sort_predicate());
 
+   // Outline optimization, tolerance and grid are given in 1/1024 em units
+   double            tolerance = val_number(tolerance_value) * em / 1024;
+   double            grid = val_number(grid_value) * em / 1024;
+   int               original_shape_bytes = 0, shape_bytes = 0;
+
+   for(i = 0; i < glyphs.size(); i++) {
+      glyph          *g = glyphs[i];
+
+      g->min_x = g->metrics.horiBearingX;
+      g->max_x = g->metrics.horiBearingX + g->metrics.width;
+      g->min_y = g->metrics.horiBearingY - g->metrics.height;
+      g->max_y = g->metrics.horiBearingY;
+
+      // Characters outside the BMP are dropped by the font module, they don't count
+      bool           emitted = g->char_code <= 0xFFFF;
+
+      if(emitted)
+         original_shape_bytes += outline_shape_bytes(g->pts);
+
+      if(tolerance >= 0.0) {
+         optimize_outline(g->pts, tolerance, grid);
+
+         // Snapping moves the points, the bounds have to follow them
+         if(grid > 0.0)
+            outline_bounds(g->pts, g->min_x, g->max_x, g->min_y, g->max_y);
+      }
+
+      if(emitted)
+         shape_bytes += outline_shape_bytes(g->pts);
+   }
+
    std::vector<kerning>      kern;
    if(FT_HAS_KERNING(face)) {
       int         n = glyphs.size();
@@ -224,6 +692,8 @@ value import_font(value font_file, value char_vector, value em_size) {
    alloc_field(ret, val_id("ascend"), alloc_int(face->ascender));
    alloc_field(ret, val_id("descend"), alloc_int(face->descender));
    alloc_field(ret, val_id("height"), alloc_int(face->height));
+   alloc_field(ret, val_id("original_shape_bytes"), alloc_int(original_shape_bytes));
+   alloc_field(ret, val_id("shape_bytes"), alloc_int(shape_bytes));
 
    // 'glyphs' field
    value             neko_glyphs = alloc_array(num_glyphs);
@@ -241,10 +711,10 @@ value import_font(value font_file, value char_vector, value em_size) {
       nga[i] = alloc_object(NULL);
       alloc_field(nga[i], val_id("char_code"), alloc_int(g->char_code));
       alloc_field(nga[i], val_id("advance"), alloc_int(g->metrics.horiAdvance));
-      alloc_field(nga[i], val_id("min_x"), alloc_int(g->metrics.horiBearingX));
-      alloc_field(nga[i], val_id("max_x"), alloc_int(g->metrics.horiBearingX + g->metrics.width));
-      alloc_field(nga[i], val_id("min_y"), alloc_int(g->metrics.horiBearingY - g->metrics.height));
-      alloc_field(nga[i], val_id("max_y"), alloc_int(g->metrics.horiBearingY));
+      alloc_field(nga[i], val_id("min_x"), alloc_int(g->min_x));
+      alloc_field(nga[i], val_id("max_x"), alloc_int(g->max_x));
+      alloc_field(nga[i], val_id("min_y"), alloc_int(g->min_y));
+      alloc_field(nga[i], val_id("max_y"), alloc_int(g->max_y));
       alloc_field(nga[i], val_id("points"), points);
 
       delete g;
@@ -275,6 +745,639 @@ value import_font(value font_file, value char_vector, value em_size) {
    return ret;
 }
 
+struct atlas_glyph {
+   FT_ULong                   char_code;
+   FT_UInt                    index;
+   int                        size_index;
+   int                        width, height;
+   int                        left, top, advance;
+   int                        x, y;
+   std::vector<unsigned char> pixels;
+
+   atlas_glyph(): width(0), height(0), x(0), y(0) { }
+};
+
+struct atlas_kerning {
+   FT_ULong                   l_char, r_char;
+   int                        x;
+
+   atlas_kerning(FT_ULong l, FT_ULong r, int x): l_char(l), r_char(r), x(x) { }
+};
+
+struct atlas_size {
+   int                        size;
+   int                        ascent, descent, height;
+   std::vector<atlas_glyph*>  glyphs;
+   std::vector<atlas_kerning> kern;
+};
+
+struct atlas_glyph_pack_predicate {
+   bool operator()(const atlas_glyph* g1, const atlas_glyph* g2) const {
+      if(g1->height != g2->height)
+         return g1->height > g2->height;
+      return g1->width > g2->width;
+   }
+};
+
+#define EDT_INF 1e20f
+
+// One dimensional squared euclidean distance transform (Felzenszwalb & Huttenlocher).
+static void edt_1d(const float *f, int n, float *d, int *v, float *z) {
+   int         k = 0, q;
+
+   v[0] = 0;
+   z[0] = -EDT_INF;
+   z[1] = EDT_INF;
+
+   for(q = 1; q < n; q++) {
+      float    s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+
+      while(s <= z[k]) {
+         k--;
+         s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+      }
+
+      k++;
+      v[k] = q;
+      z[k] = s;
+      z[k + 1] = EDT_INF;
+   }
+
+   for(k = 0, q = 0; q < n; q++) {
+      while(z[k + 1] < q)
+         k++;
+      d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+   }
+}
+
+// Squared distance transform of a grid in place (0 on the features, EDT_INF elsewhere).
+static void edt_2d(std::vector<float> &grid, int width, int height) {
+   int                  n = width > height ? width : height;
+   std::vector<float>   f(n), d(n), z(n + 1);
+   std::vector<int>     v(n);
+   int                  x, y;
+
+   for(x = 0; x < width; x++) {
+      for(y = 0; y < height; y++)
+         f[y] = grid[y * width + x];
+      edt_1d(&f[0], height, &d[0], &v[0], &z[0]);
+      for(y = 0; y < height; y++)
+         grid[y * width + x] = d[y];
+   }
+
+   for(y = 0; y < height; y++) {
+      edt_1d(&grid[y * width], width, &d[0], &v[0], &z[0]);
+      for(x = 0; x < width; x++)
+         grid[y * width + x] = d[x];
+   }
+}
+
+// Signed distance fields are computed from glyphs rendered at this multiple of the requested size.
+#define ATLAS_SDF_OVERSAMPLE 4
+
+// Floor modulo (the result is never negative).
+static int floor_mod(int a, int b) {
+   return ((a % b) + b) % b;
+}
+
+// Converts a glyph bitmap rendered at oversample times the requested size to a signed distance
+// field at the requested size padded by spread pixels on each side. The edge is mapped to 128,
+// inside values are greater, outside values are lesser.
+//
+// The distances are computed on the thresholded high resolution bitmap (where pixel centers are
+// assumed to be half a pixel away from the edge) and averaged down to the requested size, so the
+// edge position is accurate to a fraction of a target pixel.
+static void make_sdf(atlas_glyph *g, int spread, int oversample) {
+   // Align the bitmap origin to the target pixel grid and add the spread
+   int                  pad_left = spread * oversample + floor_mod(g->left, oversample);
+   int                  pad_top = spread * oversample + floor_mod(-g->top, oversample);
+   int                  w = pad_left + g->width + spread * oversample;
+   int                  h = pad_top + g->height + spread * oversample;
+   int                  x, y, i, j;
+
+   w += floor_mod(-w, oversample);
+   h += floor_mod(-h, oversample);
+
+   std::vector<float>   outside(w * h, EDT_INF);
+   std::vector<float>   inside(w * h, 0.0f);
+
+   for(y = 0; y < g->height; y++)
+      for(x = 0; x < g->width; x++)
+         if(g->pixels[y * g->width + x] >= 128) {
+            i = (y + pad_top) * w + x + pad_left;
+            outside[i] = 0.0f;
+            inside[i] = EDT_INF;
+         }
+
+   edt_2d(outside, w, h);
+   edt_2d(inside, w, h);
+
+   // Signed distance in high resolution pixels, positive outside
+   for(i = 0; i < w * h; i++)
+      outside[i] = outside[i] > 0.0f ?
+         sqrtf(outside[i]) - 0.5f :
+         0.5f - sqrtf(inside[i]);
+
+   int                  sw = w / oversample;
+   int                  sh = h / oversample;
+   float                scale = 127.0f / (spread * oversample * oversample * oversample);
+
+   g->pixels.resize(sw * sh);
+   for(y = 0; y < sh; y++)
+      for(x = 0; x < sw; x++) {
+         float    sum = 0.0f;
+
+         for(j = 0; j < oversample; j++)
+            for(i = 0; i < oversample; i++)
+               sum += outside[(y * oversample + j) * w + x * oversample + i];
+
+         float    v = 128.0f - sum * scale;
+
+         g->pixels[y * sw + x] = v < 0.0f ? 0 : v > 255.0f ? 255 : (unsigned char)(v + 0.5f);
+      }
+
+   g->width = sw;
+   g->height = sh;
+   g->left = (g->left - pad_left) / oversample;
+   g->top = (g->top + pad_top) / oversample;
+}
+
+// Frees the glyphs of every atlas size.
+static void free_atlas_glyphs(std::vector<atlas_size> &sizes) {
+   int         i, j;
+
+   for(i = 0; i < sizes.size(); i++) {
+      for(j = 0; j < sizes[i].glyphs.size(); j++)
+         delete sizes[i].glyphs[j];
+      sizes[i].glyphs.clear();
+   }
+}
+
+// Upper limit of the rendering threads.
+#define ATLAS_MAX_WORKERS 16
+
+// Rendering job of a worker thread. The (size, glyph) pairs are numbered size by size, the job
+// renders every step-th pair starting with first. Every worker has its own FreeType library
+// and face, as FreeType objects can't be shared between threads.
+struct atlas_job {
+   const char                    *font_file;
+   const std::vector<FT_UInt>    *glyph_indices;
+   const std::vector<FT_ULong>   *char_codes;
+   const std::vector<atlas_size> *sizes;
+   int                           spread, oversample;
+   int                           first, step;
+   std::vector<atlas_glyph*>     *glyphs;       // one slot per pair, NULL if the glyph is not rendered
+   bool                          failed;
+};
+
+static void render_atlas_job(atlas_job *job) {
+   FT_Library        lib;
+   FT_Face           face;
+   int               i, k;
+
+   if(FT_Init_FreeType(&lib) != 0) {
+      job->failed = true;
+      return;
+   }
+
+   if(FT_New_Face(lib, job->font_file, 0, &face) != 0) {
+      FT_Done_FreeType(lib);
+      job->failed = true;
+      return;
+   }
+
+   int               num_chars = job->glyph_indices->size();
+   int               num_pairs = num_chars * job->sizes->size();
+   int               oversample = job->oversample;
+   int               current_size = -1;
+
+   for(i = job->first; i < num_pairs; i += job->step) {
+      int            size_index = i / num_chars;
+      int            j = i % num_chars;
+
+      if(size_index != current_size) {
+         FT_Set_Pixel_Sizes(face, 0, (*job->sizes)[size_index].size * oversample);
+         current_size = size_index;
+      }
+
+      // Embedded bitmap strikes (mono or color) are skipped, only outlines are rendered
+      if(FT_Load_Glyph(face, (*job->glyph_indices)[j], FT_LOAD_NO_BITMAP) != 0 ||
+         FT_Render_Glyph(face->glyph, FT_RENDER_MODE_NORMAL) != 0 ||
+         face->glyph->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)
+         continue;
+
+      FT_Bitmap      *bm = &face->glyph->bitmap;
+      atlas_glyph    *g = new atlas_glyph;
+
+      g->char_code = (*job->char_codes)[j];
+      g->index = (*job->glyph_indices)[j];
+      g->size_index = size_index;
+      g->width = bm->width;
+      g->height = bm->rows;
+      g->left = face->glyph->bitmap_left;
+      g->top = face->glyph->bitmap_top;
+      g->advance = (face->glyph->advance.x + 32 * oversample) / (64 * oversample);
+
+      g->pixels.resize(g->width * g->height);
+      for(k = 0; k < g->height; k++) {
+         const unsigned char  *row = bm->pitch >= 0 ?
+            bm->buffer + k * bm->pitch :
+            bm->buffer + (k - g->height + 1) * bm->pitch;
+
+         std::copy(row, row + g->width, g->pixels.begin() + k * g->width);
+      }
+
+      if(job->spread > 0) {
+         if(g->width > 0 && g->height > 0)
+            make_sdf(g, job->spread, oversample);
+         else {
+            g->width = g->height = 0;
+            g->left = g->top = 0;
+         }
+      }
+
+      (*job->glyphs)[i] = g;
+   }
+
+   FT_Done_Face(face);
+   FT_Done_FreeType(lib);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI atlas_worker(LPVOID arg) {
+   render_atlas_job(static_cast<atlas_job*>(arg));
+   return 0;
+}
+#else
+static void *atlas_worker(void *arg) {
+   render_atlas_job(static_cast<atlas_job*>(arg));
+   return NULL;
+}
+#endif
+
+// Number of rendering threads to use.
+static int atlas_worker_count() {
+#ifdef _WIN32
+   SYSTEM_INFO       info;
+
+   GetSystemInfo(&info);
+   long              n = info.dwNumberOfProcessors;
+#else
+   long              n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+   return n < 1 ? 1 : n > ATLAS_MAX_WORKERS ? ATLAS_MAX_WORKERS : (int)n;
+}
+
+// Runs the first job on the calling thread and the rest on worker threads. A job is run on the
+// calling thread as well if its thread can't be started.
+static void run_atlas_jobs(std::vector<atlas_job> &jobs) {
+   int                  i, n = jobs.size();
+#ifdef _WIN32
+   std::vector<HANDLE>  threads(n, (HANDLE)NULL);
+
+   for(i = 1; i < n; i++)
+      threads[i] = CreateThread(NULL, 0, atlas_worker, &jobs[i], 0, NULL);
+#else
+   std::vector<pthread_t>  threads(n);
+   std::vector<bool>       started(n, false);
+
+   for(i = 1; i < n; i++)
+      started[i] = pthread_create(&threads[i], NULL, atlas_worker, &jobs[i]) == 0;
+#endif
+
+   render_atlas_job(&jobs[0]);
+
+   for(i = 1; i < n; i++) {
+#ifdef _WIN32
+      if(threads[i] != NULL) {
+         WaitForSingleObject(threads[i], INFINITE);
+         CloseHandle(threads[i]);
+      } else
+         render_atlas_job(&jobs[i]);
+#else
+      if(started[i])
+         pthread_join(threads[i], NULL);
+      else
+         render_atlas_job(&jobs[i]);
+#endif
+   }
+}
+
+// Renders and packs the atlas. Returns NULL and fills error (of at least ERROR_SIZE bytes) on
+// failure, so the caller can throw without live C++ objects on the stack (val_throw never returns).
+static value build_atlas(const char *font_file, value char_vector, value pixel_sizes, int spread, int padding, int max_size, char *error) {
+   FT_Face           face;
+   int               result, i, j, k;
+
+   result = FT_New_Face(ft, font_file, 0, &face);
+   if (result == FT_Err_Unknown_File_Format) {
+      sprintf(error, "Unknown file format!");
+      return NULL;
+   
+   } else if(result != 0) {
+      sprintf(error, "File open error!");
+      return NULL;
+   }
+
+   if(!FT_IS_SCALABLE(face)) {
+      FT_Done_Face(face);
+
+      sprintf(error, "Font is not scalable!");
+      return NULL;
+   }
+
+   int                        oversample = spread > 0 ? ATLAS_SDF_OVERSAMPLE : 1;
+
+   // Collect the (character code, glyph index) pairs to render
+   std::vector<FT_ULong>      char_codes;
+   std::vector<FT_UInt>       glyph_indices;
+
+   if(!val_is_null(char_vector)) {
+      value       *cva = val_array_ptr(char_vector);
+      int         num_char_codes = val_array_size(char_vector);
+
+      for(i = 0; i < num_char_codes; i++) {
+         FT_ULong    char_code = (FT_ULong)val_int(cva[i]);
+         FT_UInt     glyph_index = FT_Get_Char_Index(face, char_code);
+
+         if(glyph_index != 0) {
+            char_codes.push_back(char_code);
+            glyph_indices.push_back(glyph_index);
+         }
+      }
+
+   } else {
+      FT_ULong    char_code;
+      FT_UInt     glyph_index;
+
+      char_code = FT_Get_First_Char(face, &glyph_index);
+      while(glyph_index != 0) {
+         char_codes.push_back(char_code);
+         glyph_indices.push_back(glyph_index);
+         
+         char_code = FT_Get_Next_Char(face, char_code, &glyph_index);  
+      }
+   }
+
+   int                        num_chars = char_codes.size();
+   int                        num_sizes = val_array_size(pixel_sizes);
+   value                      *psa = val_array_ptr(pixel_sizes);
+   std::vector<atlas_size>    sizes(num_sizes);
+
+   for(i = 0; i < num_sizes; i++)
+      sizes[i].size = val_int(psa[i]);
+
+   // Rasterize the glyphs on worker threads
+   int                        num_pairs = num_chars * num_sizes;
+   int                        num_workers = atlas_worker_count();
+   std::vector<atlas_glyph*>  rendered(num_pairs, (atlas_glyph*)NULL);
+
+   if(num_workers > num_pairs)
+      num_workers = num_pairs > 0 ? num_pairs : 1;
+
+   std::vector<atlas_job>     jobs(num_workers);
+   for(i = 0; i < num_workers; i++) {
+      atlas_job      &job = jobs[i];
+
+      job.font_file = font_file;
+      job.glyph_indices = &glyph_indices;
+      job.char_codes = &char_codes;
+      job.sizes = &sizes;
+      job.spread = spread;
+      job.oversample = oversample;
+      job.first = i;
+      job.step = num_workers;
+      job.glyphs = &rendered;
+      job.failed = false;
+   }
+
+   run_atlas_jobs(jobs);
+
+   bool                       failed = false;
+   std::vector<atlas_glyph*>  packed;
+
+   for(i = 0; i < num_workers; i++)
+      failed = failed || jobs[i].failed;
+
+   for(i = 0; i < num_pairs; i++) {
+      atlas_glyph    *g = rendered[i];
+
+      if(g != NULL) {
+         sizes[g->size_index].glyphs.push_back(g);
+         if(g->width > 0 && g->height > 0)
+            packed.push_back(g);
+      }
+   }
+
+   if(failed) {
+      FT_Done_Face(face);
+      free_atlas_glyphs(sizes);
+
+      sprintf(error, "File open error!");
+      return NULL;
+   }
+
+   // Metrics and kerning at the requested sizes
+   for(i = 0; i < num_sizes; i++) {
+      atlas_size     &as = sizes[i];
+
+      FT_Set_Pixel_Sizes(face, 0, as.size);
+
+      as.ascent = (face->size->metrics.ascender + 32) >> 6;
+      as.descent = (face->size->metrics.descender + 32) >> 6;
+      as.height = (face->size->metrics.height + 32) >> 6;
+
+      if(FT_HAS_KERNING(face)) {
+         int         n = as.glyphs.size();
+         FT_Vector   v;
+
+         for(j = 0; j < n; j++) {
+            FT_UInt  l_glyph = as.glyphs[j]->index;
+
+            for(k = 0; k < n; k++) {
+               FT_UInt  r_glyph = as.glyphs[k]->index;
+
+               FT_Get_Kerning(face, l_glyph, r_glyph, FT_KERNING_DEFAULT, &v);
+               if(((v.x + 32) >> 6) != 0)
+                  as.kern.push_back( atlas_kerning(as.glyphs[j]->char_code, as.glyphs[k]->char_code, (v.x + 32) >> 6) );
+            }
+         }
+      }
+   }
+
+   FT_Done_Face(face);
+
+   if(packed.empty()) {
+      free_atlas_glyphs(sizes);
+
+      sprintf(error, "None of the requested glyphs has any pixels to render!");
+      return NULL;
+   }
+
+   // Shelf packing, tallest glyphs first. The atlas width is the smallest power of two
+   // which makes the atlas roughly square, but not wider than the maximum bitmap size.
+   std::sort(packed.begin(), packed.end(), atlas_glyph_pack_predicate());
+
+   int               area = 0, max_width = 1;
+   for(i = 0; i < packed.size(); i++) {
+      int      w = packed[i]->width + padding;
+
+      area += w * (packed[i]->height + padding);
+      if(w + padding > max_width)
+         max_width = w + padding;
+   }
+
+   int               atlas_width = 1;
+   while(atlas_width * atlas_width < area || atlas_width < max_width)
+      atlas_width <<= 1;
+
+   if(atlas_width > max_size)
+      atlas_width = max_width > max_size ? max_width : max_size;
+
+   int               pen_x = padding, pen_y = padding, shelf_height = 0;
+   for(i = 0; i < packed.size(); i++) {
+      atlas_glyph    *g = packed[i];
+
+      if(pen_x + g->width + padding > atlas_width) {
+         pen_x = padding;
+         pen_y += shelf_height + padding;
+         shelf_height = 0;
+      }
+
+      g->x = pen_x;
+      g->y = pen_y;
+      pen_x += g->width + padding;
+      if(g->height > shelf_height)
+         shelf_height = g->height;
+   }
+
+   int               atlas_height = pen_y + shelf_height + padding;
+
+   if(atlas_width > max_size || atlas_height > max_size) {
+      free_atlas_glyphs(sizes);
+
+      sprintf(error, "Atlas of %dx%d pixels exceeds the maximum bitmap size of %d pixels!", atlas_width, atlas_height, max_size);
+      return NULL;
+   }
+
+   int               atlas_bytes = atlas_width * atlas_height * 4;
+   unsigned char     *atlas_data = new unsigned char[atlas_bytes];
+
+   // White glyphs in premultiplied ARGB, coverage (or distance) goes to every channel
+   std::fill(atlas_data, atlas_data + atlas_bytes, 0);
+   for(i = 0; i < packed.size(); i++) {
+      atlas_glyph    *g = packed[i];
+
+      for(j = 0; j < g->height; j++) {
+         unsigned char  *p = atlas_data + ((g->y + j) * atlas_width + g->x) * 4;
+         unsigned char  *src = &g->pixels[j * g->width];
+
+         for(k = 0; k < g->width; k++) {
+            p[0] = p[1] = p[2] = p[3] = *src++;
+            p += 4;
+         }
+      }
+   }
+
+   value             ret = alloc_object(NULL);
+   alloc_field(ret, val_id("width"), alloc_int(atlas_width));
+   alloc_field(ret, val_id("height"), alloc_int(atlas_height));
+   alloc_field(ret, val_id("data"), copy_string((const char*)atlas_data, atlas_bytes));
+
+   delete[] atlas_data;
+
+   // 'sizes' field
+   value             neko_sizes = alloc_array(num_sizes);
+   value             *nsa = val_array_ptr(neko_sizes);
+   for(i = 0; i < num_sizes; i++) {
+      atlas_size     &as = sizes[i];
+      int            num_glyphs = as.glyphs.size();
+      int            num_kerning = as.kern.size();
+
+      value          neko_glyphs = alloc_array(num_glyphs);
+      value          *nga = val_array_ptr(neko_glyphs);
+      for(j = 0; j < num_glyphs; j++) {
+         atlas_glyph    *g = as.glyphs[j];
+
+         nga[j] = alloc_object(NULL);
+         alloc_field(nga[j], val_id("char_code"), alloc_int(g->char_code));
+         alloc_field(nga[j], val_id("x"), alloc_int(g->x));
+         alloc_field(nga[j], val_id("y"), alloc_int(g->y));
+         alloc_field(nga[j], val_id("width"), alloc_int(g->width));
+         alloc_field(nga[j], val_id("height"), alloc_int(g->height));
+         alloc_field(nga[j], val_id("left"), alloc_int(g->left));
+         alloc_field(nga[j], val_id("top"), alloc_int(g->top));
+         alloc_field(nga[j], val_id("advance"), alloc_int(g->advance));
+
+         delete g;
+      }
+
+      value          neko_kerning = alloc_array(num_kerning);
+      value          *nka = val_array_ptr(neko_kerning);
+      for(j = 0; j < num_kerning; j++) {
+         nka[j] = alloc_object(NULL);
+         alloc_field(nka[j], val_id("left_char"), alloc_int(as.kern[j].l_char));
+         alloc_field(nka[j], val_id("right_char"), alloc_int(as.kern[j].r_char));
+         alloc_field(nka[j], val_id("x"), alloc_int(as.kern[j].x));
+      }
+
+      nsa[i] = alloc_object(NULL);
+      alloc_field(nsa[i], val_id("size"), alloc_int(as.size));
+      alloc_field(nsa[i], val_id("ascent"), alloc_int(as.ascent));
+      alloc_field(nsa[i], val_id("descent"), alloc_int(as.descent));
+      alloc_field(nsa[i], val_id("height"), alloc_int(as.height));
+      alloc_field(nsa[i], val_id("glyphs"), neko_glyphs);
+      alloc_field(nsa[i], val_id("kerning"), neko_kerning);
+   }
+   alloc_field(ret, val_id("sizes"), neko_sizes);
+
+   return ret;
+}
+
+value render_atlas(value font_file, value char_vector, value pixel_sizes, value options) {
+   int               i;
+   char              error[ERROR_SIZE];
+
+   val_check(font_file, string);
+   if(!val_is_null(char_vector)) {
+      val_check(char_vector, array);
+      for(i = 0; i < val_array_size(char_vector); i++)
+         val_check(val_array_ptr(char_vector)[i], int);
+   }
+   val_check(pixel_sizes, array);
+   for(i = 0; i < val_array_size(pixel_sizes); i++)
+      val_check(val_array_ptr(pixel_sizes)[i], int);
+   val_check(options, object);
+
+   value             spread_value = val_field(options, val_id("spread"));
+   value             padding_value = val_field(options, val_id("padding"));
+   value             max_size_value = val_field(options, val_id("max_size"));
+
+   val_check(spread_value, int);
+   val_check(padding_value, int);
+   val_check(max_size_value, int);
+
+   value             ret = build_atlas(
+      val_string(font_file),
+      char_vector,
+      pixel_sizes,
+      val_int(spread_value),
+      val_int(padding_value),
+      val_int(max_size_value),
+      error
+   );
+
+   if(ret == NULL) {
+      val_throw(alloc_string(error));
+      return val_null;
+   }
+
+   return ret;
+}
+
 DEFINE_PRIM(init, 0);
-DEFINE_PRIM(import_font, 3);
+DEFINE_PRIM(import_font, 5);
+DEFINE_PRIM(corpus_char_codes, 1);
+DEFINE_PRIM(render_atlas, 4);
 
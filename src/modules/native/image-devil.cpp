@@ -6,6 +6,8 @@
 
 #include <set>
 
+#include "resample.h"
+
 extern "C" value init() {
    ilInit();
    iluInit();
@@ -36,17 +38,8 @@ extern "C" value image_info(value image_file) {
    }
 }
 
-extern "C" value import_image(value image_file) {
-   ILuint               img;
-   
-   ilGenImages(1, &img);
-   ilBindImage(img);
-
-   if(!ilLoadImage((char*)val_string(image_file))) {
-      ilDeleteImages(1, &img);
-      val_throw(alloc_string(iluErrorString(ilGetError())));
-   }
-
+// Creates the image object from the currently bound image.
+static value build_bound_image(ILuint img) {
    int            width = ilGetInteger(IL_IMAGE_WIDTH);
    int            height = ilGetInteger(IL_IMAGE_HEIGHT);
    bool           palette;
@@ -218,6 +211,141 @@ extern "C" value import_image(value image_file) {
    alloc_field(ret, val_id("data"), copy_string((const char*)img_data, img_size));
 
    delete[] img_data;
+
+   return ret;
+}
+
+// Returns the pixels of the currently bound image as ARGB premultiplied with alpha (0RGB if the
+// image has no alpha channel).
+static unsigned char *read_bound_argb(bool &alpha) {
+   int            width = ilGetInteger(IL_IMAGE_WIDTH);
+   int            height = ilGetInteger(IL_IMAGE_HEIGHT);
+   int            pixels = width * height;
+   int            i;
+
+   switch(ilGetInteger(IL_IMAGE_FORMAT)) {
+      case IL_COLOR_INDEX:
+         alpha = ilGetInteger(IL_PALETTE_TYPE) == IL_PAL_RGBA32 || ilGetInteger(IL_PALETTE_TYPE) == IL_PAL_BGRA32;
+         break;
+
+      case IL_LUMINANCE_ALPHA:
+      case IL_BGRA:
+      case IL_RGBA:
+         alpha = true;
+         break;
+
+      default:
+         alpha = false;
+         break;
+   }
+
+   ilConvertImage(IL_RGBA, IL_UNSIGNED_BYTE);
+
+   unsigned char  *argb_data = new unsigned char[pixels << 2];
+   unsigned char  *p = argb_data;
+   ILubyte        *il_data = ilGetData();
+
+   for(i = 0; i < pixels; i++) {
+      int         a = alpha ? il_data[3] : 255;
+
+      // Premultiply with alpha, alpha is always 0 in RGB data
+      p[0] = alpha ? a : 0;            // A
+      p[1] = il_data[0] * a / 255;     // R
+      p[2] = il_data[1] * a / 255;     // G
+      p[3] = il_data[2] * a / 255;     // B
+
+      p += 4;
+      il_data += 4;
+   }
+
+   return argb_data;
+}
+
+extern "C" value import_image(value image_file) {
+   ILuint               img;
+   
+   ilGenImages(1, &img);
+   ilBindImage(img);
+
+   if(!ilLoadImage((char*)val_string(image_file))) {
+      ilDeleteImages(1, &img);
+      val_throw(alloc_string(iluErrorString(ilGetError())));
+   }
+
+   value                ret = build_bound_image(img);
+
+   ilDeleteImages(1, &img);
+
+   return ret;
+}
+
+extern "C" value import_image_scaled(value image_file, value scales) {
+   val_check(image_file, string);
+   val_check(scales, array);
+
+   ILuint               img;
+   
+   ilGenImages(1, &img);
+   ilBindImage(img);
+
+   if(!ilLoadImage((char*)val_string(image_file))) {
+      ilDeleteImages(1, &img);
+      val_throw(alloc_string(iluErrorString(ilGetError())));
+   }
+
+   // The image is decoded only once, every variant is built from the same pixels
+   int                  i;
+   int                  width = ilGetInteger(IL_IMAGE_WIDTH);
+   int                  height = ilGetInteger(IL_IMAGE_HEIGHT);
+   int                  num_scales = val_array_size(scales);
+   value                *sa = val_array_ptr(scales);
+   value                ret = alloc_array(num_scales);
+   value                *ra = val_array_ptr(ret);
+
+   // Unscaled variants keep the original format (eg. palette) so they are built before
+   // the image gets converted to RGBA
+   value                original = val_null;
+   for(i = 0; i < num_scales; i++) {
+      double         scale = val_number(sa[i]);
+
+      if(resample_scaled_size(width, scale) == width && resample_scaled_size(height, scale) == height) {
+         if(val_is_null(original))
+            original = build_bound_image(img);
+
+         ra[i] = original;
+      }
+   }
+
+   bool                 alpha;
+   unsigned char        *argb_data = NULL;
+
+   for(i = 0; i < num_scales; i++) {
+      double         scale = val_number(sa[i]);
+      int            scaled_width = resample_scaled_size(width, scale);
+      int            scaled_height = resample_scaled_size(height, scale);
+
+      if(scaled_width == width && scaled_height == height)
+         continue;
+
+      if(argb_data == NULL)
+         argb_data = read_bound_argb(alpha);
+
+      int            scaled_size = (scaled_width * scaled_height) << 2;
+      unsigned char  *scaled_data = new unsigned char[scaled_size];
+
+      resample_argb(argb_data, width, height, scaled_data, scaled_width, scaled_height);
+
+      ra[i] = alloc_object(NULL);
+      alloc_field(ra[i], val_id("width"), alloc_int(scaled_width));
+      alloc_field(ra[i], val_id("height"), alloc_int(scaled_height));
+      alloc_field(ra[i], val_id("alpha"), alloc_bool(alpha));
+      alloc_field(ra[i], val_id("bits"), alloc_int(alpha ? 32 : 24));
+      alloc_field(ra[i], val_id("data"), copy_string((const char*)scaled_data, scaled_size));
+
+      delete[] scaled_data;
+   }
+
+   delete[] argb_data;
    ilDeleteImages(1, &img);
 
    return ret;
@@ -259,5 +387,6 @@ extern "C" value import_mask(value image_file) {
 DEFINE_PRIM(init, 0);
 DEFINE_PRIM(image_info, 1);
 DEFINE_PRIM(import_image, 1);
+DEFINE_PRIM(import_image_scaled, 2);
 DEFINE_PRIM(import_mask, 1);
 
@@ -8,8 +8,12 @@ typedef unsigned __int32 uint32_t;
 #include <stdint.h>
 #endif
 
+#include <string.h> /* for memcpy */
+
 #include <set>
 
+#include "resample.h"
+
 extern "C" value init() {
    MagickWandGenesis();
 
@@ -42,36 +46,49 @@ extern "C" value image_info(value image_file) {
    return ret;
 }
 
-extern "C" value import_image(value image_file) {
-   MagickWand           *wand = NewMagickWand();
-   MagickBooleanType    result;
+// Reads the image pixels as ARGB premultiplied with alpha.
+static unsigned char *read_argb(MagickWand *wand, int width, int height) {
+   int                  img_type = MagickGetImageType(wand);
+   // No alpha channel so every alpha value will be zero which results a complete transparent image.
+   // I love you ImageMagick...
+   bool                 no_alpha = (img_type == GrayscaleType || img_type == PaletteType || img_type == TrueColorType);
 
-   result = MagickReadImage(wand, (const char*)val_string(image_file));
-   if (result == MagickFalse) {
-      ExceptionType           e_type;
-      char                    *e_text;
+   int                  i;
+   int                  pixels = width * height;
+   unsigned char        *argb_data = new unsigned char[pixels * 4];
+   unsigned char        *p = argb_data;
 
-      e_text = MagickGetException(wand, &e_type);
-      DestroyMagickWand(wand);
-      val_throw(alloc_string(e_text));
+   MagickGetImagePixels(wand, 0, 0, width, height, "ARGB", CharPixel, argb_data);
+
+   if(no_alpha) {
+      for (i = 0; i < pixels; i++) {
+         p[0] = 255;
+         p += 4;
+      }
+   } else {
+      // Premultiply with alpha
+      for (i = 0; i < pixels; i++) {
+         p[1] = p[1] * p[0] / 255;
+         p[2] = p[2] * p[0] / 255;
+         p[3] = p[3] * p[0] / 255;
+         p += 4;
+      }
    }
 
-   Image                *img = GetImageFromMagickWand(wand);
-   int                  width = MagickGetImageWidth(wand);
-   int                  height = MagickGetImageHeight(wand);
-   int                  img_type = MagickGetImageType(wand);
+   return argb_data;
+}
+
+// Creates the image object from premultiplied ARGB data. Uses a colormapped image if possible.
+// Takes ownership of argb_data, truecolor images are stored in place.
+static value build_image(unsigned char *argb_data, int width, int height) {
    int                  img_size;
    unsigned char        *img_data;
    int                  bpp;
-   // No alpha channel so every alpha value will be zero which results a complete transparent image.
-   // I love you ImageMagick...
-   bool                 no_alpha = (img_type == GrayscaleType || img_type == PaletteType || img_type == TrueColorType);
 
    int                  i;
-   int                  pixels;
-   unsigned char        *argb_data;
+   int                  pixels = width * height;
    std::set<uint32_t>   color_set;
-   uint32_t             *col;
+   const uint32_t       *col;
 
    value                ret = alloc_object(NULL);
    alloc_field(ret, val_id("width"), alloc_int(width));
@@ -79,12 +96,8 @@ extern "C" value import_image(value image_file) {
    // Always create an image with alpha channel.
    alloc_field(ret, val_id("alpha"), alloc_bool(true));
 
-   pixels = width * height;
-   argb_data = new unsigned char[pixels * 4];
-   MagickGetImagePixels(wand, 0, 0, width, height, "ARGB", CharPixel, argb_data);
-
    // Try to build palette
-   col = (uint32_t*)argb_data;
+   col = (const uint32_t*)argb_data;
    for (i = 0; color_set.size() <= 256 && i < pixels; i++)
       color_set.insert(*col++);
 
@@ -103,16 +116,15 @@ extern "C" value import_image(value image_file) {
       palette = img_data;
       indices = img_data + colors * 4;
       
-      // Store palette
+      // Store palette (colors are already premultiplied)
       std::set<uint32_t>::iterator        ci, ci_end;
       for (ci = color_set.begin(), ci_end = color_set.end(); ci != ci_end; ci++) {
          uint32_t          color = *ci;
-         int               alpha = no_alpha ? 255 : color & 0xff;
          
-         palette[0] = ((color >> 8)  & 0xff) * alpha / 255;
-         palette[1] = ((color >> 16) & 0xff) * alpha / 255;
-         palette[2] = ((color >> 24) & 0xff) * alpha / 255;
-         palette[3] = alpha;
+         palette[0] = (color >> 8)  & 0xff;
+         palette[1] = (color >> 16) & 0xff;
+         palette[2] = (color >> 24) & 0xff;
+         palette[3] = color & 0xff;
 
          palette += 4;
       }
@@ -120,7 +132,7 @@ extern "C" value import_image(value image_file) {
       // Store image
       int            j;
 
-      col = (uint32_t*)argb_data;
+      col = (const uint32_t*)argb_data;
       ci = color_set.begin();
       for (i = 0; i < height; i++) {
          for (j = 0; j < width; j++) {
@@ -137,23 +149,7 @@ extern "C" value import_image(value image_file) {
       img_size = pixels * 4;
       img_data = argb_data;
       bpp = 32;
-
-      if(no_alpha) {
-         for (i = 0; i < pixels; i++) {
-            argb_data[0] = 255;
-            argb_data += 4;
-         }
-      } else {
-         // Premultiply with alpha
-         for (i = 0; i < pixels; i++) {
-            argb_data[1] = argb_data[1] * argb_data[0] / 255;
-            argb_data[2] = argb_data[2] * argb_data[0] / 255;
-            argb_data[3] = argb_data[3] * argb_data[0] / 255;
-            argb_data += 4;
-         }
-      }
    }
-   DestroyMagickWand(wand);
 
    alloc_field(ret, val_id("bits"), alloc_int(bpp));
    alloc_field(ret, val_id("data"), copy_string((const char*)img_data, img_size));
@@ -163,6 +159,97 @@ extern "C" value import_image(value image_file) {
    return ret;
 }
 
+extern "C" value import_image(value image_file) {
+   MagickWand           *wand = NewMagickWand();
+   MagickBooleanType    result;
+
+   result = MagickReadImage(wand, (const char*)val_string(image_file));
+   if (result == MagickFalse) {
+      ExceptionType           e_type;
+      char                    *e_text;
+
+      e_text = MagickGetException(wand, &e_type);
+      DestroyMagickWand(wand);
+      val_throw(alloc_string(e_text));
+   }
+
+   int                  width = MagickGetImageWidth(wand);
+   int                  height = MagickGetImageHeight(wand);
+   unsigned char        *argb_data = read_argb(wand, width, height);
+
+   DestroyMagickWand(wand);
+
+   return build_image(argb_data, width, height);
+}
+
+extern "C" value import_image_scaled(value image_file, value scales) {
+   val_check(image_file, string);
+   val_check(scales, array);
+
+   MagickWand           *wand = NewMagickWand();
+   MagickBooleanType    result;
+
+   result = MagickReadImage(wand, (const char*)val_string(image_file));
+   if (result == MagickFalse) {
+      ExceptionType           e_type;
+      char                    *e_text;
+
+      e_text = MagickGetException(wand, &e_type);
+      DestroyMagickWand(wand);
+      val_throw(alloc_string(e_text));
+   }
+
+   int                  width = MagickGetImageWidth(wand);
+   int                  height = MagickGetImageHeight(wand);
+   unsigned char        *argb_data = read_argb(wand, width, height);
+
+   DestroyMagickWand(wand);
+
+   // The image is decoded only once, every variant is resampled from the same pixels
+   int                  i;
+   int                  num_scales = val_array_size(scales);
+   value                *sa = val_array_ptr(scales);
+   value                ret = alloc_array(num_scales);
+   value                *ra = val_array_ptr(ret);
+
+   int                  last_unscaled = -1;
+
+   for (i = 0; i < num_scales; i++) {
+      double         scale = val_number(sa[i]);
+      int            scaled_width = resample_scaled_size(width, scale);
+      int            scaled_height = resample_scaled_size(height, scale);
+
+      if (scaled_width == width && scaled_height == height) {
+         last_unscaled = i;
+
+      } else {
+         unsigned char  *scaled_data = new unsigned char[scaled_width * scaled_height * 4];
+
+         resample_argb(argb_data, width, height, scaled_data, scaled_width, scaled_height);
+         ra[i] = build_image(scaled_data, scaled_width, scaled_height);
+      }
+   }
+
+   // Unscaled variants are built last so the decoded pixels can be handed over to the last one
+   for (i = 0; i < last_unscaled; i++) {
+      double         scale = val_number(sa[i]);
+
+      if (resample_scaled_size(width, scale) == width && resample_scaled_size(height, scale) == height) {
+         unsigned char  *copy = new unsigned char[width * height * 4];
+
+         memcpy(copy, argb_data, width * height * 4);
+         ra[i] = build_image(copy, width, height);
+      }
+   }
+
+   if (last_unscaled >= 0)
+      ra[last_unscaled] = build_image(argb_data, width, height);
+   else
+      delete[] argb_data;
+
+   return ret;
+}
+
 extern "C" value import_mask(value image_file) {
    MagickWand           *wand = NewMagickWand();
    MagickBooleanType    result;
@@ -199,5 +286,6 @@ extern "C" value import_mask(value image_file) {
 DEFINE_PRIM(init, 0);
 DEFINE_PRIM(image_info, 1);
 DEFINE_PRIM(import_image, 1);
+DEFINE_PRIM(import_image_scaled, 2);
 DEFINE_PRIM(import_mask, 1);
 
@@ -0,0 +1,112 @@
+#ifndef SAMHAXE_RESAMPLE_H
+#define SAMHAXE_RESAMPLE_H
+
+#include <math.h>
+
+#include <vector>
+
+// Contribution of the source pixels to a single destination pixel along one axis.
+struct resample_span {
+   int                     first;
+   std::vector<float>      weights;
+};
+
+// Computes area coverage (box filter) weights for downscaling src_size pixels to dst_size pixels.
+static void resample_build_spans(int src_size, int dst_size, std::vector<resample_span> &spans) {
+   double      ratio = (double)src_size / dst_size;
+   int         d, s;
+
+   spans.resize(dst_size);
+   for(d = 0; d < dst_size; d++) {
+      double   lo = d * ratio;
+      double   hi = (d + 1) * ratio;
+      int      first = (int)floor(lo);
+      int      last = (int)ceil(hi);
+
+      if(last > src_size)
+         last = src_size;
+
+      spans[d].first = first;
+      spans[d].weights.clear();
+      for(s = first; s < last; s++) {
+         double   a = s < lo ? lo : s;
+         double   b = s + 1 > hi ? hi : s + 1;
+
+         spans[d].weights.push_back((float)((b - a) / ratio));
+      }
+   }
+}
+
+// Downscales a premultiplied ARGB image with a separable box filter.
+//
+// Filtering premultiplied data keeps transparent pixels from bleeding their color into
+// the neighbouring opaque ones. The inner loops work on whole rows of interleaved channels
+// without any branches so the compiler is able to vectorize them.
+static void resample_argb(const unsigned char *src, int src_w, int src_h, unsigned char *dst, int dst_w, int dst_h) {
+   std::vector<resample_span>    xs, ys;
+   int                           row_len = dst_w * 4;
+   int                           x, y, k, c, i;
+
+   resample_build_spans(src_w, dst_w, xs);
+   resample_build_spans(src_h, dst_h, ys);
+
+   // Horizontal pass: src_h rows of dst_w pixels
+   std::vector<float>            tmp(src_h * row_len);
+   for(y = 0; y < src_h; y++) {
+      const unsigned char  *row = src + y * src_w * 4;
+      float                *out = &tmp[y * row_len];
+
+      for(x = 0; x < dst_w; x++) {
+         const resample_span  &span = xs[x];
+         const unsigned char  *p = row + span.first * 4;
+         int                  n = span.weights.size();
+         float                acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+         for(k = 0; k < n; k++) {
+            float    w = span.weights[k];
+
+            for(c = 0; c < 4; c++)
+               acc[c] += p[c] * w;
+            p += 4;
+         }
+
+         for(c = 0; c < 4; c++)
+            out[c] = acc[c];
+         out += 4;
+      }
+   }
+
+   // Vertical pass: accumulate whole rows
+   std::vector<float>            acc(row_len);
+   for(y = 0; y < dst_h; y++) {
+      const resample_span  &span = ys[y];
+      int                  n = span.weights.size();
+      unsigned char        *out = dst + y * row_len;
+
+      for(i = 0; i < row_len; i++)
+         acc[i] = 0.0f;
+
+      for(k = 0; k < n; k++) {
+         const float    *r = &tmp[(span.first + k) * row_len];
+         float          w = span.weights[k];
+
+         for(i = 0; i < row_len; i++)
+            acc[i] += r[i] * w;
+      }
+
+      for(i = 0; i < row_len; i++) {
+         float    v = acc[i] + 0.5f;
+
+         out[i] = v >= 255.0f ? 255 : (unsigned char)v;
+      }
+   }
+}
+
+// Returns the size of a dimension scaled by the given factor (at least one pixel).
+static int resample_scaled_size(int size, double scale) {
+   int         s = (int)floor(size * scale + 0.5);
+
+   return s < 1 ? 1 : s;
+}
+
+#endif